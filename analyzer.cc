@@ -29,15 +29,27 @@ int Analyzer::not_distance(Val x, Val y)
     return d < n ? d : n;
 }
 
+// without -mpopcnt the builtin is a call into libgcc, the instruction
+// is picked at run time where the cpu has it.
+#if !defined(__POPCNT__) && (defined(__x86_64__) || defined(__i386__))
+#define POPCNT_DISPATCH
+
+__attribute__((target("popcnt")))
+static int popcnt(Val x)
+{
+	return __builtin_popcountll(x);
+}
+
+static const bool has_popcnt = (__builtin_cpu_init(), __builtin_cpu_supports("popcnt"));
+#endif
+
 int Analyzer::base_distance(Val x, Val y)
 {
-	Val v = x ^ y;
-	// do the bit count
-	int count;
-	for (count = 0; v; count++) {
-		v = (v - 1) & v;
-	}
-	return count;
+#ifdef POPCNT_DISPATCH
+	if (has_popcnt)
+		return popcnt(x ^ y);
+#endif
+	return __builtin_popcountll(x ^ y);
 }
 
 string Analyzer::sdist(Val x, Val y)
@@ -0,0 +1,232 @@
+#include "bank.h"
+
+#include <string.h>
+
+Expr* ExprPool::make(Op op, Expr* a, Expr* b, Expr* c)
+{
+	nodes_.push_back(Expr());
+	Expr* e = &nodes_.back();
+	e->op = op;
+	e->parent = NULL;
+	e->flags = 0;
+	e->bits = KnownBits::top();
+	e->opnd[0] = a;
+	e->opnd[1] = b;
+	e->opnd[2] = c;
+	for (int i = 0; i < 3; i++)
+		if (e->opnd[i])
+			e->opnd[i]->parent = e;
+	return e;
+}
+
+Expr* ExprPool::var(int id)
+{
+	Expr* e = make(VAR);
+	e->var = id;
+	return e;
+}
+
+Expr* ExprPool::clone(Expr* e)
+{
+	Expr* opnd[3] = { NULL, NULL, NULL };
+	int arity = e->arity();
+	for (int i = 0; i < arity; i++)
+		opnd[i] = clone(e->opnd[i]);
+	Expr* c = make(e->op, opnd[0], opnd[1], opnd[2]);
+	c->flags = e->flags;
+	c->bits = e->bits;
+	c->val = e->val; // var as well
+	return c;
+}
+
+int ExprPool::size(Expr* e)
+{
+	// fold takes one more for its lambda.
+	int s = e->op == FOLD ? 2 : 1;
+	int arity = e->arity();
+	for (int i = 0; i < arity; i++)
+		s += size(e->opnd[i]);
+	return s;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+void Bank::set_inputs(const std::vector<Val>& inputs)
+{
+	inputs_ = inputs;
+	n_ = inputs.size();
+	scratch_.resize(n_);
+	terms_.clear();
+	values_.clear();
+	first_.clear();
+	table_.clear();
+	complete_size_ = 0;
+	tries_ = 0;
+	expired_ = false;
+	rehash(1024);
+}
+
+void Bank::pick_pairs(const Verifier::Pairs& pairs, std::vector<Val>* inputs, std::vector<Val>* outputs)
+{
+	long n = pairs.size();
+	long recent = MAX_INPUTS / 4;
+	long spread = MAX_INPUTS - recent;
+	long i = 0;
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it, i++) {
+		// of the older ones, every time i * spread / (n - recent) steps up.
+		bool take = n <= MAX_INPUTS || i >= n - recent
+			|| (i + 1) * spread / (n - recent) != i * spread / (n - recent);
+		if (!take)
+			continue;
+		inputs->push_back(it->first);
+		if (outputs)
+			outputs->push_back(it->second);
+	}
+}
+
+Val Bank::hash(const Val* values, int n)
+{
+	Val h = 0xcbf29ce484222325ul;
+	for (int i = 0; i < n; i++) {
+		h ^= values[i];
+		h *= 0x9e3779b97f4a7c15ul;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+int Bank::find(const Val* values) const
+{
+	size_t mask = table_.size() - 1;
+	for (size_t i = hash(values, n_) & mask; table_[i]; i = (i + 1) & mask) {
+		int t = table_[i] - 1;
+		if (memcmp(this->values(t), values, n_ * sizeof(Val)) == 0)
+			return t;
+	}
+	return -1;
+}
+
+void Bank::insert(int t)
+{
+	size_t mask = table_.size() - 1;
+	size_t i = hash(values(t), n_) & mask;
+	while (table_[i])
+		i = (i + 1) & mask;
+	table_[i] = t + 1;
+}
+
+void Bank::rehash(int capacity)
+{
+	table_.assign(capacity, 0);
+	for (int t = 0; t < (int)terms_.size(); t++)
+		insert(t);
+}
+
+bool Bank::add(Op op, int a, int b, int c, int size)
+{
+	if ((++tries_ & 0xfff) == 0 && deadline_ && Verifier::now_ms() > deadline_)
+		expired_ = true;
+	Val* v = &scratch_[0];
+	switch (op) {
+	case C0:  memset(v, 0, n_ * sizeof(Val)); break;
+	case C1:  for (int i = 0; i < n_; i++) v[i] = 1; break;
+	case VAR: memcpy(v, &inputs_[0], n_ * sizeof(Val)); break;
+	default: {
+		const Val* va = values(a);
+		const Val* vb = b >= 0 ? values(b) : va;
+		const Val* vc = c >= 0 ? values(c) : va;
+		for (int i = 0; i < n_; i++)
+			v[i] = Expr::apply(op, va[i], vb[i], vc[i]);
+	}
+	}
+	if (find(v) >= 0)
+		return false;
+
+	Term t;
+	t.op = op;
+	t.opnd[0] = a;
+	t.opnd[1] = b;
+	t.opnd[2] = c;
+	t.size = size;
+	terms_.push_back(t);
+	values_.insert(values_.end(), v, v + n_);
+	if (terms_.size() * 2 > table_.size())
+		rehash(table_.size() * 2);
+	else
+		insert(terms_.size() - 1);
+	return true;
+}
+
+void Bank::grow(int size)
+{
+	static const Op unary[] = { NOT, SHL1, SHR1, SHR4, SHR16 };
+	static const Op binary[] = { AND, OR, XOR, PLUS };
+
+	for (int s = complete_size_ + 1; s <= size; s++) {
+		if (full())
+			return;
+		first_.resize(s + 1);
+		first_[s] = terms_.size();
+
+		if (s == 1) {
+			add(C0, -1, -1, -1, 1);
+			add(C1, -1, -1, -1, 1);
+			add(VAR, -1, -1, -1, 1);
+		}
+
+		for (int i = 0; i < sizeof(unary) / sizeof(*unary); i++) {
+			if (!allowed_ops_.has(unary[i]) || s < 2)
+				continue;
+			for (int a = first(s - 1); a < first_[s] && !full(); a++)
+				add(unary[i], a, -1, -1, s);
+		}
+
+		// all binary ops commute, keep the smaller operand first.
+		for (int i = 0; i < sizeof(binary) / sizeof(*binary); i++) {
+			if (!allowed_ops_.has(binary[i]))
+				continue;
+			for (int sa = 1; sa <= (s - 1) / 2; sa++) {
+				int sb = s - 1 - sa;
+				for (int a = first(sa); a < first(sa + 1); a++) {
+					for (int b = sa == sb ? a : first(sb); b < first(sb + 1) && b < first_[s]; b++) {
+						add(binary[i], a, b, -1, s);
+						if (full())
+							return;
+					}
+				}
+			}
+		}
+
+		if (allowed_ops_.has(IF0)) {
+			for (int sc = 1; sc <= s - 3; sc++) {
+				for (int st = 1; st <= s - 2 - sc; st++) {
+					int se = s - 1 - sc - st;
+					for (int c = first(sc); c < first(sc + 1); c++) {
+						for (int a = first(st); a < first(st + 1); a++) {
+							for (int b = first(se); b < first(se + 1) && b < first_[s]; b++) {
+								add(IF0, c, a, b, s);
+								if (full())
+									return;
+							}
+						}
+					}
+				}
+			}
+		}
+		complete_size_ = s;
+	}
+}
+
+Expr* Bank::build(int t, ExprPool* pool) const
+{
+	const Term& term = terms_[t];
+	if (term.op == VAR)
+		return pool->var(0);
+	Expr* opnd[3] = { NULL, NULL, NULL };
+	for (int i = 0; i < 3; i++)
+		if (term.opnd[i] >= 0)
+			opnd[i] = build(term.opnd[i], pool);
+	return pool->make(term.op, opnd[0], opnd[1], opnd[2]);
+}
@@ -0,0 +1,93 @@
+#ifndef BANK_H
+#define BANK_H
+
+#include "gen2.h"
+
+#include <deque>
+#include <vector>
+
+// Owns Expr trees built outside of an Arena.
+class ExprPool
+{
+public:
+	Expr* make(Op op, Expr* a = NULL, Expr* b = NULL, Expr* c = NULL);
+	Expr* var(int id);
+	// deep copy, e.g. of a program living in an Arena.
+	Expr* clone(Expr* e);
+	void clear() { nodes_.clear(); }
+
+	static int size(Expr* e);
+
+private:
+	std::deque<Expr> nodes_;
+};
+
+// Fold-free terms over x0 together with their values on the sample inputs.
+// Terms are built by size and only the smallest term of every distinct
+// value vector is kept, so the bank is complete up to complete_size().
+class Bank
+{
+public:
+	struct Term {
+		Op  op;
+		int opnd[3];
+		int size;
+	};
+
+	Bank() : n_(0), max_terms_(1 << 18), complete_size_(0), tries_(0), deadline_(0), expired_(false) {}
+
+	void set_inputs(const std::vector<Val>& inputs);
+	void set_max_terms(int n) { max_terms_ = n; }
+	// grow stops at this Verifier::now_ms() time, 0 for never.
+	void set_deadline(long ms) { deadline_ = ms; }
+
+	// values are kept for this many pairs at most, a term is 8 bytes per pair.
+	enum { MAX_INPUTS = 64 };
+	// up to MAX_INPUTS of the pairs: the last ones, where the counterexamples
+	// of wrong guesses are, and the others spread over the rest.
+	static void pick_pairs(const Verifier::Pairs& pairs, std::vector<Val>* inputs,
+		std::vector<Val>* outputs);
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+
+	// enumerates terms up to size, as far as max_terms allows.
+	void grow(int size);
+
+	int inputs() const { return n_; }
+	int count() const { return terms_.size(); }
+	int complete_size() const { return complete_size_; }
+	const Term& term(int t) const { return terms_[t]; }
+	const Val* values(int t) const { return &values_[(size_t)t * n_]; }
+
+	// terms of exactly size s are [first(s), first(s + 1)).
+	int first(int s) const { return s < (int)first_.size() ? first_[s] : terms_.size(); }
+
+	// smallest term with exactly these values, -1 if none.
+	int find(const Val* values) const;
+	static Val hash(const Val* values, int n);
+
+	Expr* build(int t, ExprPool* pool) const;
+
+	OpSet allowed_ops_;
+
+private:
+	bool add(Op op, int a, int b, int c, int size);
+	// also gives up when most of the work only finds duplicates.
+	bool full() const { return (int)terms_.size() >= max_terms_ || tries_ >= 64l * max_terms_ || expired_; }
+	void insert(int t);
+	void rehash(int capacity);
+
+	int n_;
+	int max_terms_;
+	int complete_size_;
+	long tries_;
+	long deadline_;
+	bool expired_;
+	std::vector<Val> inputs_;
+	std::vector<Term> terms_;
+	std::vector<Val> values_;
+	std::vector<int> first_;
+	std::vector<int> table_; // open addressing, term index + 1
+	std::vector<Val> scratch_;
+};
+
+#endif
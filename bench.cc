@@ -0,0 +1,407 @@
+#include "gen2.h"
+#include "analyzer.h"
+#include "bank.h"
+#include "parser.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+// Microbenchmarks of the evaluation and enumeration kernels, a program of
+// its own:
+//     bench [-c cpu] [name filter]
+// built with the flags of the solver it measures, e.g.
+//     g++ -O2 -pthread -o bench bench.cc $SOLVER
+// where SOLVER is the search without protocol.cc,
+//     gen2.cc rules.cc bank.cc parser.cc analyzer.cc telemetry.cc eventlog.cc
+//     model.cc iofeatures.cc goal.cc mitm.cc partition.cc bitsynth.cc
+//     bestfirst.cc mcmc.cc
+// The process is pinned to one cpu, every benchmark is warmed up, then
+// timed in samples of at least 10 ms each. It reports the median time per
+// item with its median absolute deviation and the fastest sample, so a
+// regression shows up as a median moving by more than a few MADs.
+
+static long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000l + ts.tv_nsec;
+}
+
+// results go here so the compiler keeps the work.
+static volatile Val sink;
+
+static Val inputs[1024];
+
+static void fill_inputs()
+{
+	Val x = 0x2545f4914f6cdd1dul;
+	for (int i = 0; i < 1024; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		// dense, sparse and single byte ones, as in eval batches.
+		inputs[i] = i % 3 == 0 ? x : i % 3 == 1 ? x & (x >> 5) : x & 0xff;
+	}
+}
+
+// One timed kernel. run() does a call's worth of work and returns how many
+// items it covered, e.g. programs enumerated.
+class Bench
+{
+public:
+	Bench(const char* name) : name_(name) {}
+	virtual ~Bench() {}
+
+	virtual long run() = 0;
+
+	const char* name_;
+};
+
+struct Result
+{
+	double median; // ns per item
+	double mad;
+	double min;
+	long items;    // per call
+};
+
+static double median(std::vector<double> v)
+{
+	std::sort(v.begin(), v.end());
+	int n = v.size();
+	return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static Result measure(Bench* b)
+{
+	const int samples = 31;
+	const long sample_ns = 10000000;
+
+	// warm up caches and branch predictors, and see how long a call takes.
+	long calls = 0, items = 0;
+	long started = now_ns();
+	while (now_ns() - started < 100000000 || calls < 3) {
+		items += b->run();
+		calls++;
+	}
+	long per_sample = (long)((double)sample_ns * calls / (now_ns() - started)) + 1;
+
+	std::vector<double> times;
+	for (int s = 0; s < samples; s++) {
+		long n = 0;
+		long t = now_ns();
+		for (long i = 0; i < per_sample; i++)
+			n += b->run();
+		times.push_back((double)(now_ns() - t) / n);
+	}
+
+	Result r;
+	r.median = median(times);
+	std::vector<double> deviations;
+	for (int s = 0; s < samples; s++)
+		deviations.push_back(times[s] > r.median ? times[s] - r.median : r.median - times[s]);
+	r.mad = median(deviations);
+	r.min = *std::min_element(times.begin(), times.end());
+	r.items = items / calls;
+	return r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+// Programs of the shapes the contest had, from tiny to bonus sized.
+static const struct { const char* name; const char* program; } shapes[] = {
+	{ "small",  "(lambda (x0) (xor x0 (shl1 x0)))" },
+	{ "if0",    "(lambda (x0) (if0 (and x0 1) (shr4 (plus x0 x0)) (not (shr16 x0))))" },
+	{ "fold",   "(lambda (x0) (fold x0 0 (lambda (y z) (or y (shl1 z)))))" },
+	{ "tfold",  "(lambda (x0) (fold x0 0 (lambda (y z) (plus (if0 (shr1 z) y z) (shr4 (xor y z))))))" },
+	{ "bonus",  "(lambda (x0) (if0 (and (plus x0 1) 1) (or (shr16 x0) (shl1 (xor x0 (shr4 x0)))) "
+	            "(plus (not (and x0 (shr1 x0))) (shr16 (shr16 (plus x0 x0))))))" },
+};
+
+static ExprPool pool;
+
+static Expr* program(int shape)
+{
+	Parser parser;
+	Expr* e = parser.parse(shapes[shape].program, &pool);
+	if (!e) {
+		fprintf(stderr, "%s: %s\n", shapes[shape].name, parser.error_.c_str());
+		exit(1);
+	}
+	return e;
+}
+
+static Expr* find_fold(Expr* e)
+{
+	if (e->op == FOLD)
+		return e;
+	for (int i = 0; i < e->arity(); i++)
+		if (Expr* f = find_fold(e->opnd[i]))
+			return f;
+	return NULL;
+}
+
+// Expr::eval through run, on 1024 inputs.
+class EvalBench : public Bench
+{
+public:
+	EvalBench(const char* name, Expr* e) : Bench(name), e_(e) {}
+
+	long run()
+	{
+		Val acc = 0;
+		for (int i = 0; i < 1024; i++)
+			acc += e_->run(inputs[i]);
+		sink = acc;
+		return 1024;
+	}
+
+	Expr* e_;
+};
+
+// the fold node alone, with x0 in the context.
+class FoldBench : public Bench
+{
+public:
+	FoldBench(const char* name, Expr* fold) : Bench(name), fold_(fold) {}
+
+	long run()
+	{
+		Val acc = 0;
+		Context ctx;
+		for (int i = 0; i < 1024; i++) {
+			ctx.count = 0;
+			ctx.push(inputs[i]);
+			acc += fold_->do_fold(&ctx);
+		}
+		sink = acc;
+		return 1024;
+	}
+
+	Expr* fold_;
+};
+
+// Verifier::action on a candidate rejected by the first pair, the common
+// case, or only by the last one.
+class VerifierBench : public Bench
+{
+public:
+	VerifierBench(const char* name, Expr* secret, Expr* candidate, bool late)
+		: Bench(name), candidate_(candidate)
+	{
+		for (int i = 0; i < 63; i++)
+			verifier_.add(inputs[i], (late ? candidate : secret)->run(inputs[i]));
+		verifier_.add(inputs[63], ~candidate->run(inputs[63]));
+	}
+
+	long run()
+	{
+		long rejected = 0;
+		for (int i = 0; i < 256; i++)
+			rejected += verifier_.action(candidate_, 10);
+		sink = rejected;
+		return 256;
+	}
+
+	Verifier verifier_;
+	Expr* candidate_;
+};
+
+static Arena arena;
+
+static void reset_arena(int size, int vars)
+{
+	arena.arena_ptr = 0;
+	arena.valents_ptr = 0;
+	arena.num_vars_ = vars;
+	arena.size_ = size;
+	arena.valence_ = 1;
+	arena.done_ = false;
+	arena.no_more_fold_ = false;
+}
+
+// a push and pop of a small tree, with a constant subtree folded on push.
+class PushPopBench : public Bench
+{
+public:
+	PushPopBench(const char* name, bool constant) : Bench(name), constant_(constant) {}
+
+	long run()
+	{
+		reset_arena(30, 1);
+		for (int i = 0; i < 256; i++) {
+			arena.push_op(VAR, 0);
+			arena.push_op(constant_ ? C1 : VAR, 0);
+			arena.push_op(constant_ ? SHL1 : NOT);
+			arena.push_op(PLUS);
+			sink = arena.arena[arena.arena_ptr - 1].bits.zero;
+			arena.pop_op();
+			arena.pop_op();
+			arena.pop_op();
+			arena.pop_op();
+		}
+		return 256 * 4;
+	}
+
+	bool constant_;
+};
+
+// takes every program and asks for more.
+class Counter : public Callback
+{
+public:
+	Counter() : count_(0) {}
+	bool action(Expr* e, int size) { count_++; return true; }
+
+	long count_;
+};
+
+// every fold lambda of a program of the given size, from (fold x0 0 ...).
+class EmitFoldBench : public Bench
+{
+public:
+	EmitFoldBench(const char* name, int size, const Op* ops, int n)
+		: Bench(name), size_(size), ops_(ops), n_(n) {}
+
+	long run()
+	{
+		Counter counter;
+		reset_arena(size_ - 1, 1);
+		arena.allowed_ops_ = OpSet();
+		for (int i = 0; i < n_; i++)
+			arena.add_allowed_op(ops_[i]);
+		arena.add_allowed_op(FOLD);
+		arena.add_allowed_op(C0);
+		arena.add_allowed_op(C1);
+		arena.add_allowed_op(VAR);
+		arena.set_callback(&counter);
+		arena.observed_ = Observed();
+		arena.push_op(VAR, 0);
+		arena.push_op(C0);
+		arena.emit_fold();
+		arena.pop_op();
+		arena.pop_op();
+		return counter.count_ ? counter.count_ : 1;
+	}
+
+	int size_;
+	const Op* ops_;
+	int n_;
+};
+
+// a whole enumeration, per program.
+class GenerateBench : public Bench
+{
+public:
+	GenerateBench(const char* name, int size, const Op* ops, int n)
+		: Bench(name), size_(size), ops_(ops), n_(n) {}
+
+	long run()
+	{
+		Counter counter;
+		Arena* a = new Arena;
+		a->set_callback(&counter);
+		for (int i = 0; i < n_; i++)
+			a->add_allowed_op(ops_[i]);
+		a->generate(size_);
+		delete a;
+		return counter.count_ ? counter.count_ : 1;
+	}
+
+	int size_;
+	const Op* ops_;
+	int n_;
+};
+
+class DistanceBench : public Bench
+{
+public:
+	DistanceBench(const char* name) : Bench(name) {}
+
+	long run()
+	{
+		int acc = 0;
+		for (int i = 0; i < 1024; i += 2)
+			acc += analyzer_.distance(inputs[i], inputs[i + 1]);
+		sink = acc;
+		return 512;
+	}
+
+	Analyzer analyzer_;
+};
+
+static bool pin(int cpu)
+{
+	cpu_set_t set;
+	if (cpu < 0) {
+		// the last cpu we may run on, usually the quietest one.
+		if (sched_getaffinity(0, sizeof(set), &set))
+			return false;
+		for (int i = CPU_SETSIZE - 1; i >= 0 && cpu < 0; i--)
+			if (CPU_ISSET(i, &set))
+				cpu = i;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		return false;
+	printf("pinned to cpu %d\n", cpu);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int cpu = -1;
+	int c;
+	while ((c = getopt(argc, argv, "c:")) != -1) {
+		if (c != 'c') {
+			fprintf(stderr, "usage: %s [-c cpu] [name filter]\n", argv[0]);
+			return 1;
+		}
+		cpu = atoi(optarg);
+	}
+	const char* filter = optind < argc ? argv[optind] : "";
+	if (!pin(cpu))
+		perror("sched_setaffinity");
+
+	fill_inputs();
+	std::vector<Bench*> benches;
+	char name[64];
+	for (int s = 0; s < sizeof(shapes) / sizeof(*shapes); s++) {
+		snprintf(name, sizeof(name), "eval/%s", shapes[s].name);
+		benches.push_back(new EvalBench(strdup(name), program(s)));
+	}
+	benches.push_back(new FoldBench("do_fold/fold", find_fold(program(2))));
+	benches.push_back(new FoldBench("do_fold/tfold", find_fold(program(3))));
+	benches.push_back(new VerifierBench("verifier/first_pair", program(0), program(1), false));
+	benches.push_back(new VerifierBench("verifier/last_pair", program(0), program(1), true));
+	benches.push_back(new VerifierBench("verifier/fold_last_pair", program(3), program(3), true));
+	benches.push_back(new PushPopBench("arena/push_pop", false));
+	benches.push_back(new PushPopBench("arena/push_pop_const", true));
+
+	static const Op few[] = { SHL1, PLUS, XOR };
+	static const Op many[] = { IF0, NOT, SHR1, SHR4, AND, OR, PLUS };
+	benches.push_back(new EmitFoldBench("emit_fold/8_few", 8, few, 3));
+	benches.push_back(new EmitFoldBench("emit_fold/10_many", 10, many, 7));
+	benches.push_back(new GenerateBench("generate/8_many", 8, many, 7));
+	benches.push_back(new DistanceBench("analyzer/distance"));
+
+	printf("%-26s %12s %10s %12s %10s\n", "benchmark", "ns/item", "mad", "min", "items");
+	for (int i = 0; i < benches.size(); i++) {
+		if (!strstr(benches[i]->name_, filter))
+			continue;
+		Result r = measure(benches[i]);
+		printf("%-26s %12.2f %9.1f%% %12.2f %10ld\n", benches[i]->name_, r.median,
+			100 * r.mad / r.median, r.min, r.items);
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include "bestfirst.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+BestFirst::BestFirst()
+{
+	verifier_ = NULL;
+	expanded_ = 0;
+	pruned_ = 0;
+	trimmed_ = 0;
+	max_len_ = 0;
+	max_queue_ = 1 << 20;
+	max_expanded_ = 500000;
+	weight_ = 8;
+}
+
+// ties go to the longer program, it is closer to being complete.
+bool BestFirst::Worse::operator()(const Node& a, const Node& b) const
+{
+	if (a.score != b.score)
+		return a.score > b.score;
+	return a.len < b.len;
+}
+
+void BestFirst::refresh()
+{
+	inputs_.clear();
+	outputs_.clear();
+	const Verifier::Pairs& pairs = verifier_->get_pairs();
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+		inputs_.push_back(it->first);
+		outputs_.push_back(it->second);
+	}
+}
+
+bool BestFirst::generate(int size)
+{
+	static const Op all[] = { VAR, C0, C1, NOT, SHL1, SHR1, SHR4, SHR16, AND, OR, XOR, PLUS, IF0 };
+	ops_.clear();
+	for (int k = 0; k < sizeof(all) / sizeof(*all); k++)
+		if (Expr::arity(all[k]) == 0 || allowed_ops_.has(all[k]))
+			ops_.push_back(all[k]);
+
+	// the lambda takes one.
+	max_len_ = size - 1;
+	if (max_len_ > MAX_LEN)
+		max_len_ = MAX_LEN;
+	refresh();
+	stack_.resize(max_len_);
+	queue_.clear();
+
+	Node root;
+	root.len = 1;
+	root.tok[0] = HOLE;
+	root.score = 0;
+	push(root);
+
+	while (!queue_.empty() && expanded_ < max_expanded_) {
+		std::pop_heap(queue_.begin(), queue_.end(), Worse());
+		Node n = queue_.back();
+		queue_.pop_back();
+		// the deadline is only checked once in a while.
+		if ((++expanded_ & 0xfff) == 0 && !verifier_->poll())
+			break;
+
+		int h = 0;
+		while (n.tok[h] != HOLE)
+			h++;
+		for (int k = 0; k < (int)ops_.size(); k++) {
+			Op op = ops_[k];
+			int arity = Expr::arity(op);
+			if (n.len + arity > max_len_)
+				continue;
+			// (not (not x)) is x, the hole's parent is right before it.
+			if (op == NOT && h > 0 && n.tok[h - 1] == NOT)
+				continue;
+
+			Node child;
+			child.len = n.len + arity;
+			memcpy(child.tok, n.tok, h);
+			child.tok[h] = op;
+			memset(child.tok + h + 1, HOLE, arity);
+			memcpy(child.tok + h + 1 + arity, n.tok + h + 1, n.len - h - 1);
+
+			bool complete;
+			if (!evaluate(&child, &complete)) {
+				pruned_++;
+				continue;
+			}
+			if (!complete) {
+				push(child);
+				continue;
+			}
+			// every output matched exactly
+			int pos = 0;
+			Expr* e = build(child, &pos);
+			size_t seen = verifier_->get_pairs().size();
+			bool go_on = verifier_->action(e, child.len + 1);
+			pool_.clear();
+			if (!go_on)
+				return true;
+			// the queue was scored without the new pairs, its programs
+			// meet them when expanded.
+			if (verifier_->get_pairs().size() != seen)
+				refresh();
+		}
+	}
+	return false;
+}
+
+void BestFirst::push(const Node& n)
+{
+	if ((int)queue_.size() >= max_queue_)
+		trim();
+	queue_.push_back(n);
+	std::push_heap(queue_.begin(), queue_.end(), Worse());
+}
+
+void BestFirst::trim()
+{
+	std::sort(queue_.begin(), queue_.end(), Worse());
+	// sorted worst first
+	int drop = queue_.size() / 2;
+	queue_.erase(queue_.begin(), queue_.begin() + drop);
+	std::make_heap(queue_.begin(), queue_.end(), Worse());
+	trimmed_ += drop;
+}
+
+bool BestFirst::evaluate(Node* node, bool* complete)
+{
+	int n = inputs_.size();
+	int holes = 0;
+	for (int i = 0; i < node->len; i++)
+		holes += node->tok[i] == HOLE;
+	*complete = holes == 0;
+
+	long unknown = 0;
+	KnownBits none = KnownBits::top();
+	for (int j = 0; j < n; j++) {
+		// run backwards, the first operand ends up on top.
+		int sp = 0;
+		for (int i = node->len - 1; i >= 0; i--) {
+			Op op = (Op)node->tok[i];
+			switch (op) {
+			case HOLE: stack_[sp++] = none; break;
+			case VAR:  stack_[sp++] = KnownBits::exact(inputs_[j]); break;
+			case C0:
+			case C1:   stack_[sp++] = KnownBits::apply(op, none, none, none); break;
+			default: {
+				int arity = Expr::arity(op);
+				KnownBits* a = &stack_[sp - 1];
+				KnownBits r = KnownBits::apply(op, a[0], arity > 1 ? a[-1] : none, arity > 2 ? a[-2] : none);
+				sp -= arity;
+				stack_[sp++] = r;
+				break;
+			}
+			}
+		}
+		KnownBits k = stack_[0];
+		Observed o;
+		o.add(outputs_[j]);
+		if (!o.admits(k))
+			return false;
+		unknown += __builtin_popcountll(~k.known());
+	}
+	node->score = node->len + weight_ * unknown / (64.0f * n);
+	return true;
+}
+
+Expr* BestFirst::build(const Node& n, int* pos)
+{
+	Op op = (Op)n.tok[(*pos)++];
+	if (op == VAR)
+		return pool_.var(0);
+	Expr* opnd[3] = { NULL, NULL, NULL };
+	int arity = Expr::arity(op);
+	for (int i = 0; i < arity; i++)
+		opnd[i] = build(n, pos);
+	return pool_.make(op, opnd[0], opnd[1], opnd[2]);
+}
@@ -0,0 +1,66 @@
+#ifndef BESTFIRST_H
+#define BESTFIRST_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <vector>
+
+// Best-first enumeration of fold-free programs. A partial program is a
+// preorder token string where holes stand for operands still to be chosen;
+// the leftmost hole is filled first. Partial programs are run on every
+// input with the holes as unknown bits, so the bits they already fix can
+// be compared with the outputs: a contradiction drops the program, and the
+// more output bits are fixed the sooner it is expanded. The queue is
+// bounded, the worst half is dropped when it fills up.
+class BestFirst
+{
+public:
+	BestFirst();
+
+	void set_callback(Verifier* v) { verifier_ = v; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+	void set_max_queue(int n) { max_queue_ = n; }
+	void set_max_expanded(long n) { max_expanded_ = n; }
+
+	// true if the callback asked to stop.
+	bool generate(int size);
+
+	OpSet allowed_ops_;
+	long expanded_;
+	long pruned_;
+	long trimmed_;
+
+private:
+	enum { MAX_LEN = 32, HOLE = DUMMY_OP };
+
+	struct Node {
+		float score;
+		unsigned char len;
+		unsigned char tok[MAX_LEN];
+	};
+	struct Worse {
+		bool operator()(const Node& a, const Node& b) const;
+	};
+
+	void refresh();
+	void push(const Node& n);
+	void trim();
+	// false if the known bits contradict an output, sets the score.
+	bool evaluate(Node* n, bool* complete);
+	Expr* build(const Node& n, int* pos);
+
+	Verifier* verifier_;
+	ExprPool pool_;
+	std::vector<Node> queue_; // heap, best on top
+	std::vector<Val> inputs_;
+	std::vector<Val> outputs_;
+	std::vector<KnownBits> stack_;
+	std::vector<Op> ops_;
+	int max_len_;
+	int max_queue_;
+	long max_expanded_;
+	float weight_; // of a fully unknown output against one node
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "bitsynth.h"
+
+#include <stdio.h>
+
+static const int INF = 1000;
+
+// truth tables of the three leaves, bit m is the value at minterm m.
+static const int var_mask[3] = { 0xaa, 0xcc, 0xf0 };
+
+BitSynth::BitSynth()
+{
+	verifier_ = NULL;
+	checked_ = 0;
+}
+
+bool BitSynth::covers(OpSet ops)
+{
+	return !ops.has(PLUS) && !ops.has(IF0) && !ops.has(FOLD);
+}
+
+void BitSynth::reset(int size)
+{
+	static const Op unary[] = { NOT, SHL1, SHR1, SHR4, SHR16 };
+	std::vector<Val> inputs;
+	outputs_.clear();
+	const Verifier::Pairs& pairs = verifier_->get_pairs();
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+		inputs.push_back(it->first);
+		outputs_.push_back(it->second);
+	}
+
+	// leaves: unary chains over x0, 0 and 1, small ones first.
+	bank_.allowed_ops_ = OpSet();
+	for (int k = 0; k < sizeof(unary) / sizeof(*unary); k++)
+		if (allowed_ops_.has(unary[k]))
+			bank_.add_allowed_op(unary[k]);
+	bank_.set_max_terms(256);
+	bank_.set_inputs(inputs);
+	bank_.grow(size - 1);
+	pool_.clear();
+}
+
+bool BitSynth::consistent(int a, int b, int c, int* want, int* care)
+{
+	checked_++;
+	const Val* va = bank_.values(a);
+	const Val* vb = bank_.values(b);
+	const Val* vc = bank_.values(c);
+	int ones = 0, zeros = 0;
+	int n = outputs_.size();
+	for (int j = 0; j < n; j++) {
+		Val out = outputs_[j];
+		for (int m = 0; m < 8; m++) {
+			Val bits = (m & 1 ? va[j] : ~va[j]) & (m & 2 ? vb[j] : ~vb[j]) & (m & 4 ? vc[j] : ~vc[j]);
+			if (!bits)
+				continue;
+			Val set = out & bits;
+			if (set)
+				ones |= 1 << m;
+			if (set != bits)
+				zeros |= 1 << m;
+			if (ones & zeros)
+				return false;
+		}
+	}
+	*want = ones;
+	*care = ones | zeros;
+	return true;
+}
+
+const BitSynth::Table& BitSynth::table(int ca, int cb, int cc)
+{
+	int key = (ca * 64 + cb) * 64 + cc;
+	std::map<int, Table>::iterator it = tables_.find(key);
+	if (it != tables_.end())
+		return it->second;
+
+	Table& t = tables_[key];
+	for (int f = 0; f < 256; f++)
+		t.cost[f] = INF;
+	int costs[3] = { ca, cb, cc };
+	for (int v = 0; v < 3; v++) {
+		if (costs[v] < t.cost[var_mask[v]]) {
+			t.cost[var_mask[v]] = costs[v];
+			t.op[var_mask[v]] = VAR;
+			t.a[var_mask[v]] = v;
+		}
+	}
+	t.cost[0] = 1;
+	t.op[0] = C0;
+
+	static const Op binary[] = { AND, OR, XOR };
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int f = 0; f < 256; f++) {
+			if (t.cost[f] == INF)
+				continue;
+			if (allowed_ops_.has(NOT) && t.cost[f] + 1 < t.cost[f ^ 0xff]) {
+				t.cost[f ^ 0xff] = t.cost[f] + 1;
+				t.op[f ^ 0xff] = NOT;
+				t.a[f ^ 0xff] = f;
+				changed = true;
+			}
+			for (int g = f; g < 256; g++) {
+				if (t.cost[g] == INF)
+					continue;
+				int cost = t.cost[f] + t.cost[g] + 1;
+				for (int k = 0; k < 3; k++) {
+					if (!allowed_ops_.has(binary[k]))
+						continue;
+					int r = binary[k] == AND ? f & g : binary[k] == OR ? f | g : f ^ g;
+					if (cost < t.cost[r]) {
+						t.cost[r] = cost;
+						t.op[r] = binary[k];
+						t.a[r] = f;
+						t.b[r] = g;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+	return t;
+}
+
+Expr* BitSynth::build(const Table& t, int f, const int* leaves)
+{
+	switch (t.op[f]) {
+	case VAR: return bank_.build(leaves[t.a[f]], &pool_);
+	case C0:  return pool_.make(C0);
+	case NOT: return pool_.make(NOT, build(t, t.a[f], leaves));
+	default:  return pool_.make(t.op[f], build(t, t.a[f], leaves), build(t, t.b[f], leaves));
+	}
+}
+
+bool BitSynth::generate(int size)
+{
+	for (;;) {
+		size_t seen = verifier_->get_pairs().size();
+		reset(size);
+
+		// leaves may repeat, which covers functions of one or two leaves.
+		int count = bank_.count();
+		// sizes below count the lambda.
+		int best_size = size + 1;
+		int best_f = -1;
+		int best[3];
+		const Table* best_table = NULL;
+		for (int a = 0; a < count; a++) {
+			int ca = bank_.term(a).size;
+			if (ca + 1 >= best_size)
+				break;
+			if (!verifier_->poll())
+				return false;
+			for (int b = a; b < count; b++) {
+				int cb = bank_.term(b).size;
+				if (cb + 1 >= best_size)
+					break;
+				for (int c = b; c < count; c++) {
+					int cc = bank_.term(c).size;
+					if (cc + 1 >= best_size)
+						break;
+					int want, care;
+					if (!consistent(a, b, c, &want, &care))
+						continue;
+					const Table& t = table(ca, cb, cc);
+					for (int f = 0; f < 256; f++) {
+						if (((f ^ want) & care) || t.cost[f] + 1 >= best_size)
+							continue;
+						best_size = t.cost[f] + 1;
+						best_f = f;
+						best[0] = a;
+						best[1] = b;
+						best[2] = c;
+						best_table = &t;
+					}
+				}
+			}
+		}
+		if (best_f < 0)
+			return false;
+
+		Expr* e = build(*best_table, best_f, best);
+		if (!verifier_->action(e, ExprPool::size(e) + 1))
+			return true;
+		if (!verifier_->settle())
+			return true;
+		if (verifier_->get_pairs().size() == seen)
+			return false;
+	}
+}
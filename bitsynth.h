@@ -0,0 +1,56 @@
+#ifndef BITSYNTH_H
+#define BITSYNTH_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <map>
+#include <vector>
+
+// Synthesis for problems whose ops are all bitwise or shifts (no plus, if0
+// or fold). With the shifts pushed down to the leaves, such a program is
+// one Boolean function applied at every bit position to a few shifted
+// copies of the input (or of a constant). Leaves come from a bank of unary
+// chains; every set of up to three leaves is checked for a truth table
+// consistent with all output bits, and the smallest formula over and, or,
+// xor and not for that table is assembled directly.
+class BitSynth
+{
+public:
+	BitSynth();
+
+	void set_callback(Verifier* v) { verifier_ = v; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+
+	// whether the op set is one BitSynth covers.
+	static bool covers(OpSet ops);
+
+	// true if the callback asked to stop.
+	bool generate(int size);
+
+	OpSet allowed_ops_;
+	long checked_;
+
+private:
+	// smallest formulas of all 3-input functions for given leaf sizes.
+	struct Table {
+		int cost[256];
+		Op op[256];
+		unsigned char a[256];
+		unsigned char b[256];
+	};
+
+	void reset(int size);
+	// truth table of the leaves at a, b, c, false if none fits.
+	bool consistent(int a, int b, int c, int* want, int* care);
+	const Table& table(int ca, int cb, int cc);
+	Expr* build(const Table& t, int f, const int* leaves);
+
+	Verifier* verifier_;
+	Bank bank_;
+	ExprPool pool_;
+	std::vector<Val> outputs_;
+	std::map<int, Table> tables_; // by leaf sizes
+};
+
+#endif
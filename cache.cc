@@ -0,0 +1,132 @@
+#define __STDC_FORMAT_MACROS
+
+#include "cache.h"
+#include "parser.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+// spread over bytes, nibbles and single bits so that shifts, folds and
+// if0 on the low bit show in the outputs.
+static const Val probes[] = {
+	0x0, 0x1, 0xffffffffffffffff, 0x8000000000000000,
+	0x5a3c96e1d2b4f807, 0x0123456789abcdef, 0xfedcba9876543210, 0x00000000000000ff,
+	0xff00ff00ff00ff00, 0x0f0f0f0f0f0f0f0f, 0x8421084210842108, 0x7fffffffffffffff,
+	0x00010203a0b0c0d0, 0xc3a5e7d2b4f60819, 0x0000000080000000, 0x6db6db6db6db6db6
+};
+static const int num_probes = sizeof(probes) / sizeof(*probes);
+
+void SolutionCache::probe_inputs(std::vector<Val>* inputs)
+{
+	for (int i = 0; i < num_probes; i++)
+		inputs->push_back(probes[i]);
+}
+
+Val SolutionCache::fingerprint(const Val* outputs)
+{
+	Val h = 0xcbf29ce484222325ul;
+	for (int i = 0; i < num_probes; i++) {
+		h ^= outputs[i];
+		h *= 0x9e3779b97f4a7c15ul;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+int SolutionCache::load(const char* path)
+{
+	path_ = path;
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return 0;
+	char line[4096];
+	int n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		Val fp;
+		int skip;
+		if (sscanf(line, "%" SCNx64 " %n", &fp, &skip) < 1)
+			continue;
+		string program = line + skip;
+		while (!program.empty() && (program[program.size() - 1] == '\n' || program[program.size() - 1] == '\r'))
+			program.erase(program.size() - 1);
+		programs_.insert(std::make_pair(fp, program));
+		n++;
+	}
+	fclose(f);
+	return n;
+}
+
+bool SolutionCache::add(const string& program)
+{
+	ExprPool pool;
+	Parser parser;
+	Expr* e = parser.parse(program, &pool);
+	if (!e) {
+		fprintf(stderr, "cache: %s in %s\n", parser.error_.c_str(), program.c_str());
+		return false;
+	}
+	Val outputs[num_probes];
+	for (int i = 0; i < num_probes; i++)
+		outputs[i] = e->run(probes[i]);
+	Val fp = fingerprint(outputs);
+
+	std::pair<Programs::iterator, Programs::iterator> range = programs_.equal_range(fp);
+	for (Programs::iterator it = range.first; it != range.second; ++it)
+		if (it->second == program)
+			return false;
+	programs_.insert(std::make_pair(fp, program));
+
+	if (!path_.empty()) {
+		FILE* f = fopen(path_.c_str(), "a");
+		if (f) {
+			fprintf(f, "%016" PRIx64 " %s\n", fp, program.c_str());
+			fclose(f);
+		}
+	}
+	return true;
+}
+
+int SolutionCache::import_log(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return 0;
+	// a guess is printed as "  N: (lambda ...)" and followed by its response.
+	char line[4096];
+	string last;
+	int n = 0;
+	while (fgets(line, sizeof(line), f)) {
+		const char* lambda = strstr(line, "(lambda");
+		const char* challenge = strstr(line, "\"challenge\"");
+		if (challenge && lambda) {
+			// a train response carries its secret.
+			string program = lambda;
+			program.erase(program.find_last_of(')') + 1);
+			n += add(program);
+		} else if (lambda) {
+			last = lambda;
+			last.erase(last.find_last_of(')') + 1);
+		} else if ((strstr(line, "\"status\" : \"win\"") || strstr(line, "\"status\":\"win\"")) && !last.empty()) {
+			n += add(last);
+			last.clear();
+		} else if (strstr(line, "Challenge ACCEPTED")) {
+			last.clear();
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+void SolutionCache::lookup(const Val* outputs, std::vector<string>* programs) const
+{
+	std::pair<Programs::const_iterator, Programs::const_iterator> range =
+		programs_.equal_range(fingerprint(outputs));
+	for (Programs::const_iterator it = range.first; it != range.second; ++it)
+		programs->push_back(it->second);
+}
+
+void SolutionCache::programs(std::vector<string>* programs) const
+{
+	for (Programs::const_iterator it = programs_.begin(); it != programs_.end(); ++it)
+		programs->push_back(it->second);
+}
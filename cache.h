@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "gen2.h"
+
+#include <map>
+#include <vector>
+
+// Programs found or seen so far, kept across runs in a text file of
+// "<fingerprint hex> <program>" lines. The fingerprint hashes a program's
+// outputs on a fixed set of probe inputs, which challenge sends with its
+// first eval, so a secret seen before is a single map lookup away.
+class SolutionCache
+{
+public:
+	SolutionCache() {}
+
+	// the probe inputs, in the order fingerprint() expects the outputs.
+	static void probe_inputs(std::vector<Val>* inputs);
+	static Val fingerprint(const Val* outputs);
+
+	// lines that don't parse are skipped, a missing file is empty.
+	int load(const char* path);
+	// false if the program doesn't parse or is known already, appended to
+	// the loaded file otherwise.
+	bool add(const string& program);
+	// winning guesses and train challenges found in a protocol log.
+	int import_log(const char* path);
+
+	// programs with these outputs on the probe inputs.
+	void lookup(const Val* outputs, std::vector<string>* programs) const;
+	int count() const { return programs_.size(); }
+	void programs(std::vector<string>* programs) const;
+
+private:
+	typedef std::multimap<Val, string> Programs;
+
+	Programs programs_;
+	string path_;
+};
+
+#endif
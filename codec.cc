@@ -0,0 +1,490 @@
+#include "codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const Val ones = 0x0101010101010101ul;
+static const Val highs = 0x8080808080808080ul;
+
+// high bit of every byte of x strictly between m and n, for bytes and
+// bounds below 0x80.
+static inline Val bytes_between(Val x, int m, int n)
+{
+	return (ones * (127 + n) - (x & ones * 127)) & ~x & ((x & ones * 127) + ones * (127 - m)) & highs;
+}
+
+// eight digits, first one most significant, loaded little endian.
+static inline bool hex8(const char* s, Val* v)
+{
+	Val x;
+	memcpy(&x, s, 8);
+	Val digits = bytes_between(x, '0' - 1, '9' + 1);
+	Val letters = bytes_between(x | ones * 0x20, 'a' - 1, 'f' + 1);
+	if ((digits | letters) != highs || (x & highs))
+		return false;
+	// '0'-'9' keep their low nibble, letters get 9 more.
+	Val nibbles = (x & ones * 0x0f) + ((x >> 6) & ones) * 9;
+	// pack pairs, then quads, then the two halves.
+	Val t = ((nibbles & 0x000f000f000f000ful) << 4) | ((nibbles >> 8) & 0x000f000f000f000ful);
+	t = ((t & 0x000000ff000000fful) << 8) | ((t >> 16) & 0x000000ff000000fful);
+	*v = ((t & 0xffff) << 16) | ((t >> 32) & 0xffff);
+	return true;
+}
+
+bool Codec::parse_hex(const char* s, int len, Val* v)
+{
+	if (len >= 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		s += 2;
+		len -= 2;
+	}
+	if (len <= 0 || len > 16)
+		return false;
+	// right aligned in zeros, so that every value takes the same path.
+	char buffer[16];
+	memset(buffer, '0', 16);
+	memcpy(buffer + 16 - len, s, len);
+	Val high, low;
+	if (!hex8(buffer, &high) || !hex8(buffer + 8, &low))
+		return false;
+	*v = (high << 32) | low;
+	return true;
+}
+
+void Codec::put_hex(Val v, char* out)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	out[0] = '0';
+	out[1] = 'x';
+	for (int i = 0; i < 16; i++)
+		out[2 + i] = digits[(v >> (60 - 4 * i)) & 0xf];
+}
+
+const string& Codec::eval_request(const string& id, const Val* inputs, int n)
+{
+	out_.clear();
+	out_ += "{\"id\":\"";
+	out_ += id;
+	out_ += "\",\"arguments\":[";
+	char buffer[21];
+	buffer[0] = '"';
+	buffer[19] = '"';
+	buffer[20] = ',';
+	for (int i = 0; i < n; i++) {
+		put_hex(inputs[i], buffer + 1);
+		out_.append(buffer, i + 1 < n ? 21 : 20);
+	}
+	out_ += "]}";
+	return out_;
+}
+
+const string& Codec::guess_request(const string& id, const string& program)
+{
+	out_.clear();
+	out_ += "{\"id\":\"";
+	out_ += id;
+	out_ += "\",\"program\":\"";
+	out_ += program;
+	out_ += "\"}";
+	return out_;
+}
+
+const string& Codec::train_request(int size, const char* operators)
+{
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "{\"size\":%d,\"operators\":\"%s\"}", size, operators);
+	out_ = buffer;
+	return out_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+// A position in a response; every call leaves it past what it read.
+struct Cursor
+{
+	Cursor(const char* data, size_t len) : p(data), end(data + len) {}
+
+	void skip_space()
+	{
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+			p++;
+	}
+
+	bool eat(char c)
+	{
+		skip_space();
+		if (p < end && *p == c) {
+			p++;
+			return true;
+		}
+		return false;
+	}
+
+	bool peek(char c)
+	{
+		skip_space();
+		return p < end && *p == c;
+	}
+
+	// the raw text between the quotes, escapes are left as they are.
+	bool string_value(const char** s, int* len)
+	{
+		if (!eat('"'))
+			return false;
+		const char* start = p;
+		while (p < end && *p != '"')
+			p += *p == '\\' ? 2 : 1;
+		if (p >= end)
+			return false;
+		*s = start;
+		*len = p - start;
+		p++;
+		return true;
+	}
+
+	bool string_value(string* s)
+	{
+		const char* start;
+		int len;
+		if (!string_value(&start, &len))
+			return false;
+		s->assign(start, len);
+		return true;
+	}
+
+	bool int_value(int* v)
+	{
+		skip_space();
+		char* after;
+		long x = strtol(p, &after, 10);
+		if (after == p || after > end)
+			return false;
+		*v = x;
+		p = after;
+		return true;
+	}
+
+	bool bool_value(bool* v)
+	{
+		skip_space();
+		if (end - p >= 4 && !memcmp(p, "true", 4)) {
+			*v = true;
+			p += 4;
+			return true;
+		}
+		if (end - p >= 5 && !memcmp(p, "false", 5)) {
+			*v = false;
+			p += 5;
+			return true;
+		}
+		return false;
+	}
+
+	bool skip_value()
+	{
+		skip_space();
+		if (p >= end)
+			return false;
+		if (*p == '"') {
+			const char* s;
+			int len;
+			return string_value(&s, &len);
+		}
+		if (*p == '{' || *p == '[') {
+			char close = *p == '{' ? '}' : ']';
+			p++;
+			if (eat(close))
+				return true;
+			do {
+				if (close == '}') {
+					const char* s;
+					int len;
+					if (!string_value(&s, &len) || !eat(':'))
+						return false;
+				}
+				if (!skip_value())
+					return false;
+			} while (eat(','));
+			return eat(close);
+		}
+		// numbers, true, false and null.
+		const char* start = p;
+		while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n')
+			p++;
+		return p > start;
+	}
+
+	// the next member of an object being read: after '{' or a value.
+	bool next_key(const char** key, int* len)
+	{
+		if (peek('}'))
+			return false;
+		eat(',');
+		return string_value(key, len) && eat(':');
+	}
+
+	const char* p;
+	const char* end;
+};
+
+static bool is_key(const char* key, int len, const char* name)
+{
+	return len == strlen(name) && !memcmp(key, name, len);
+}
+
+bool Codec::parse_eval(const char* data, size_t len, Val* outputs, int n)
+{
+	Cursor c(data, len);
+	if (!c.eat('{'))
+		return false;
+	bool ok = false;
+	int got = -1;
+	const char* key;
+	int key_len;
+	while (c.next_key(&key, &key_len)) {
+		if (is_key(key, key_len, "status")) {
+			const char* s;
+			int s_len;
+			if (!c.string_value(&s, &s_len))
+				return false;
+			ok = is_key(s, s_len, "ok");
+		} else if (is_key(key, key_len, "outputs")) {
+			if (!c.eat('['))
+				return false;
+			got = 0;
+			if (!c.eat(']')) {
+				do {
+					const char* s;
+					int s_len;
+					if (got >= n || !c.string_value(&s, &s_len) || !parse_hex(s, s_len, &outputs[got]))
+						return false;
+					got++;
+				} while (c.eat(','));
+				if (!c.eat(']'))
+					return false;
+			}
+		} else if (!c.skip_value()) {
+			return false;
+		}
+	}
+	return ok && got == n;
+}
+
+bool Codec::parse_guess(const char* data, size_t len, Guess* guess)
+{
+	Cursor c(data, len);
+	if (!c.eat('{'))
+		return false;
+	guess->status.clear();
+	guess->message.clear();
+	guess->num_values = 0;
+	const char* key;
+	int key_len;
+	while (c.next_key(&key, &key_len)) {
+		bool ok;
+		if (is_key(key, key_len, "status")) {
+			ok = c.string_value(&guess->status);
+		} else if (is_key(key, key_len, "message")) {
+			ok = c.string_value(&guess->message);
+		} else if (is_key(key, key_len, "values")) {
+			ok = c.eat('[');
+			if (ok && !c.eat(']')) {
+				do {
+					const char* s;
+					int s_len;
+					ok = c.string_value(&s, &s_len) && guess->num_values < 3 &&
+						parse_hex(s, s_len, &guess->values[guess->num_values++]);
+				} while (ok && c.eat(','));
+				ok = ok && c.eat(']');
+			}
+		} else {
+			ok = c.skip_value();
+		}
+		if (!ok)
+			return false;
+	}
+	return !guess->status.empty();
+}
+
+// one problem object, the cursor on its '{'.
+static bool parse_problem_object(Cursor& c, Codec::Problem* problem)
+{
+	if (!c.eat('{'))
+		return false;
+	problem->id.clear();
+	problem->size = 0;
+	problem->operators.clear();
+	problem->solved = false;
+	problem->time_left = -1;
+	problem->challenge.clear();
+	const char* key;
+	int key_len;
+	while (c.next_key(&key, &key_len)) {
+		bool ok;
+		if (is_key(key, key_len, "id")) {
+			ok = c.string_value(&problem->id);
+		} else if (is_key(key, key_len, "size")) {
+			ok = c.int_value(&problem->size);
+		} else if (is_key(key, key_len, "solved")) {
+			ok = c.bool_value(&problem->solved);
+		} else if (is_key(key, key_len, "timeLeft")) {
+			ok = c.int_value(&problem->time_left);
+		} else if (is_key(key, key_len, "challenge")) {
+			ok = c.string_value(&problem->challenge);
+		} else if (is_key(key, key_len, "operators")) {
+			ok = c.eat('[');
+			if (ok && !c.eat(']')) {
+				do {
+					const char* s;
+					int s_len;
+					ok = c.string_value(&s, &s_len);
+					if (ok) {
+						if (!problem->operators.empty())
+							problem->operators += ' ';
+						problem->operators.append(s, s_len);
+					}
+				} while (ok && c.eat(','));
+				ok = ok && c.eat(']');
+			}
+		} else {
+			ok = c.skip_value();
+		}
+		if (!ok)
+			return false;
+	}
+	return c.eat('}') && !problem->id.empty();
+}
+
+bool Codec::parse_problem(const char* data, size_t len, Problem* problem)
+{
+	Cursor c(data, len);
+	return parse_problem_object(c, problem);
+}
+
+bool Codec::parse_problems(const char* data, size_t len, std::vector<Problem>* problems)
+{
+	Cursor c(data, len);
+	if (!c.eat('['))
+		return false;
+	if (c.eat(']'))
+		return true;
+	do {
+		problems->push_back(Problem());
+		if (!parse_problem_object(c, &problems->back()))
+			return false;
+	} while (c.eat(','));
+	return c.eat(']');
+}
+
+#ifdef CODECMAIN
+
+// Times the eval round trip, request and response, through jsoncpp the way
+// Protocol used to do it and through the codec.
+
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+#include <sys/time.h>
+#include <jsoncpp/json/json.h>
+#include <sstream>
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int main(int argc, char* argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+	const int n = 256;
+	Val inputs[n], outputs[n], expected[n];
+	Val x = 0x9e3779b97f4a7c15ul;
+	for (int i = 0; i < n; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		inputs[i] = x;
+		expected[i] = x * 3 + i;
+	}
+	string id = "WFGeIarmB5EIJyjx3aTtB3Vd";
+
+	// a response as the server sends it.
+	string response = "{\"id\":\"" + id + "\",\"status\":\"ok\",\"outputs\":[";
+	for (int i = 0; i < n; i++) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%s\"0x%016" PRIX64 "\"", i ? "," : "", expected[i]);
+		response += buffer;
+	}
+	response += "]}";
+
+	size_t bytes = 0;
+	double start = now();
+	for (int r = 0; r < rounds; r++) {
+		Json::Value arguments(Json::arrayValue);
+		for (int i = 0; i < n; i++) {
+			char buffer[100];
+			snprintf(buffer, sizeof(buffer), "0x%" PRIx64, inputs[i]);
+			arguments[i] = buffer;
+		}
+		Json::Value request;
+		request["id"] = id;
+		request["arguments"] = arguments;
+		bytes += request.toStyledString().size();
+
+		std::stringstream stream;
+		stream.write(response.data(), response.size());
+		Json::Reader reader;
+		Json::Value result;
+		reader.parse(stream, result);
+		Json::Value values = result["outputs"];
+		for (int i = 0; i < n; i++)
+			sscanf(values[i].asCString(), "%" PRIx64, &outputs[i]);
+	}
+	double json = now() - start;
+	printf("jsoncpp: %8.2f us per eval, %lu request bytes, %s\n", json / rounds * 1e6, bytes / rounds,
+		memcmp(outputs, expected, sizeof(outputs)) ? "WRONG" : "ok");
+
+	Codec codec;
+	bytes = 0;
+	memset(outputs, 0, sizeof(outputs));
+	start = now();
+	for (int r = 0; r < rounds; r++) {
+		bytes += codec.eval_request(id, inputs, n).size();
+		if (!Codec::parse_eval(response.data(), response.size(), outputs, n))
+			printf("parse failed\n");
+	}
+	double codec_time = now() - start;
+	printf("codec:   %8.2f us per eval, %lu request bytes, %s\n", codec_time / rounds * 1e6, bytes / rounds,
+		memcmp(outputs, expected, sizeof(outputs)) ? "WRONG" : "ok");
+
+	// the hex strings alone.
+	size_t first = response.find("0x");
+	start = now();
+	Val sum = 0;
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < n; i++) {
+			Val v;
+			sscanf(response.c_str() + first + i * 21, "%" PRIx64, &v);
+			sum += v;
+		}
+	}
+	double scanf_time = now() - start;
+	start = now();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < n; i++) {
+			Val v;
+			Codec::parse_hex(response.c_str() + first + i * 21, 18, &v);
+			sum -= v;
+		}
+	}
+	double hex_time = now() - start;
+	printf("hex: sscanf %.1f ns, swar %.1f ns per value%s\n", scanf_time / rounds / n * 1e9,
+		hex_time / rounds / n * 1e9, sum ? " (mismatch)" : "");
+	printf("speedup %.1fx\n", json / codec_time);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "gen2.h"
+
+#include <vector>
+
+// The contest API's messages without a JSON DOM: requests are written as
+// compact JSON into a buffer kept between calls, responses are walked in
+// place and only the fields we use are picked up. Hex values are decoded
+// eight digits at a time with SWAR arithmetic.
+class Codec
+{
+public:
+	struct Guess {
+		string status;  // win, mismatch or error
+		Val values[3];  // input, expected and our output on a mismatch
+		int num_values;
+		string message;
+	};
+
+	struct Problem {
+		string id;
+		int size;
+		string operators; // space separated
+		bool solved;
+		int time_left; // -1 if not given
+		string challenge; // the secret, in train responses
+	};
+
+	const string& eval_request(const string& id, const Val* inputs, int n);
+	const string& guess_request(const string& id, const string& program);
+	const string& train_request(int size, const char* operators);
+
+	// false if malformed or not ok.
+	static bool parse_eval(const char* data, size_t len, Val* outputs, int n);
+	// false if malformed, the status tells the rest.
+	static bool parse_guess(const char* data, size_t len, Guess* guess);
+	// a train response.
+	static bool parse_problem(const char* data, size_t len, Problem* problem);
+	// a myproblems response.
+	static bool parse_problems(const char* data, size_t len, std::vector<Problem>* problems);
+
+	// up to 16 hex digits, with or without 0x.
+	static bool parse_hex(const char* s, int len, Val* v);
+	// "0x" and 16 digits.
+	static void put_hex(Val v, char* out);
+
+private:
+	string out_;
+};
+
+#endif
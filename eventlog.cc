@@ -0,0 +1,341 @@
+#include "eventlog.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// single producer, the owning thread, and single consumer, the flusher.
+struct Ring
+{
+	enum { SIZE = 1 << 20 };
+
+	char data[SIZE];
+	uint64_t head; // written by the producer
+	uint64_t tail; // written by the consumer
+	uint32_t thread;
+	volatile bool free; // its thread exited, taken again once drained
+	Ring* next;
+};
+
+static FILE* file_ = NULL;
+static volatile bool open_ = false;
+static volatile bool stop_ = false;
+static pthread_t flusher_;
+static pthread_mutex_t rings_lock_ = PTHREAD_MUTEX_INITIALIZER;
+static Ring* rings_ = NULL;
+static uint32_t threads_ = 0;
+static long dropped_ = 0;
+static __thread Ring* ring_ = NULL;
+static pthread_key_t exit_key_;
+static pthread_once_t exit_once_ = PTHREAD_ONCE_INIT;
+
+static uint64_t now_usec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ul + tv.tv_usec;
+}
+
+static void drain(Ring* r)
+{
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = r->tail;
+	while (tail < head) {
+		size_t at = tail & (Ring::SIZE - 1);
+		size_t n = head - tail;
+		if (at + n > Ring::SIZE)
+			n = Ring::SIZE - at;
+		fwrite(r->data + at, 1, n, file_);
+		tail += n;
+	}
+	__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void drain_all()
+{
+	pthread_mutex_lock(&rings_lock_);
+	for (Ring* r = rings_; r; r = r->next)
+		drain(r);
+	pthread_mutex_unlock(&rings_lock_);
+	fflush(file_);
+}
+
+static void* flush_loop(void*)
+{
+	while (!stop_) {
+		usleep(20000);
+		drain_all();
+	}
+	drain_all();
+	return NULL;
+}
+
+// MCMC starts threads for every challenge, their rings go back for reuse.
+static void release(void* ring)
+{
+	__atomic_store_n(&((Ring*)ring)->free, true, __ATOMIC_RELEASE);
+}
+
+static void make_exit_key()
+{
+	pthread_key_create(&exit_key_, release);
+}
+
+static Ring* take_ring()
+{
+	pthread_once(&exit_once_, make_exit_key);
+	pthread_mutex_lock(&rings_lock_);
+	Ring* r = rings_;
+	while (r && !(__atomic_load_n(&r->free, __ATOMIC_ACQUIRE) &&
+			__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head))
+		r = r->next;
+	if (!r) {
+		r = new Ring;
+		r->head = r->tail = 0;
+		r->next = rings_;
+		rings_ = r;
+	}
+	r->free = false;
+	r->thread = threads_++;
+	pthread_mutex_unlock(&rings_lock_);
+	pthread_setspecific(exit_key_, r);
+	return r;
+}
+
+bool EventLog::open(const char* path)
+{
+	if (open_)
+		return true;
+	file_ = fopen(path, "ab");
+	if (!file_)
+		return false;
+	stop_ = false;
+	if (pthread_create(&flusher_, NULL, flush_loop, NULL)) {
+		fclose(file_);
+		file_ = NULL;
+		return false;
+	}
+	open_ = true;
+	return true;
+}
+
+void EventLog::close()
+{
+	if (!open_)
+		return;
+	open_ = false;
+	stop_ = true;
+	pthread_join(flusher_, NULL);
+	fclose(file_);
+	file_ = NULL;
+	// rings stay with their threads for a later open.
+}
+
+long EventLog::dropped()
+{
+	return __atomic_load_n(&dropped_, __ATOMIC_RELAXED);
+}
+
+void EventLog::write(int type, const void* payload, int length)
+{
+	if (!open_)
+		return;
+	Ring* r = ring_;
+	if (!r)
+		r = ring_ = take_ring();
+
+	uint64_t need = (sizeof(Header) + length + 7) & ~7ul;
+	uint64_t head = r->head;
+	if (need > Ring::SIZE - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))) {
+		__atomic_fetch_add(&dropped_, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	char record[sizeof(Header) + 512];
+	if (need > sizeof(record)) {
+		__atomic_fetch_add(&dropped_, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	Header* h = (Header*)record;
+	h->type = type;
+	h->length = length;
+	h->thread = r->thread;
+	h->usec = now_usec();
+	memcpy(record + sizeof(Header), payload, length);
+	memset(record + sizeof(Header) + length, 0, need - sizeof(Header) - length);
+
+	// records are 8 byte aligned in a power of two ring, but may still wrap.
+	size_t at = head & (Ring::SIZE - 1);
+	size_t first = need;
+	if (at + first > Ring::SIZE)
+		first = Ring::SIZE - at;
+	memcpy(r->data + at, record, first);
+	memcpy(r->data, record + first, need - first);
+	__atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+}
+
+// payloads: fixed fields first, then NUL terminated strings.
+static int put_string(char* at, const string& s, int room)
+{
+	int n = s.size() + 1 < room ? s.size() + 1 : room;
+	memcpy(at, s.c_str(), n);
+	at[n - 1] = 0;
+	return n;
+}
+
+void EventLog::challenge(const string& id, int size, const string& operators)
+{
+	char payload[400];
+	int32_t s = size;
+	memcpy(payload, &s, 4);
+	int n = 4;
+	n += put_string(payload + n, id, 64);
+	n += put_string(payload + n, operators, sizeof(payload) - n);
+	write(CHALLENGE, payload, n);
+}
+
+void EventLog::eval(Val in, Val out)
+{
+	Val payload[2] = { in, out };
+	write(EVAL, payload, sizeof(payload));
+}
+
+void EventLog::candidate(long count, int size, const string& program)
+{
+	char payload[500];
+	int64_t c = count;
+	int32_t s = size;
+	memcpy(payload, &c, 8);
+	memcpy(payload + 8, &s, 4);
+	int n = 12 + put_string(payload + 12, program, sizeof(payload) - 12);
+	write(CANDIDATE, payload, n);
+}
+
+void EventLog::guess(const string& program, const string& status)
+{
+	char payload[500];
+	int n = put_string(payload, status, 32);
+	n += put_string(payload + n, program, sizeof(payload) - n);
+	write(GUESS, payload, n);
+}
+
+void EventLog::timing(const char* label, long ms)
+{
+	char payload[200];
+	int64_t m = ms;
+	memcpy(payload, &m, 8);
+	int n = 8 + put_string(payload + 8, label, sizeof(payload) - 8);
+	write(TIMING, payload, n);
+}
+
+#ifdef EVENTMAIN
+
+// Prints an event log in the text format of the old traces, e.g. for
+// SolutionCache::import_log.
+
+#include <algorithm>
+#include <vector>
+
+struct Record
+{
+	EventLog::Header header;
+	std::vector<char> payload;
+};
+
+static bool by_time(const Record& a, const Record& b)
+{
+	return a.header.usec < b.header.usec;
+}
+
+static void print_bits(Val v)
+{
+	for (int i = 0; i < 64; i++) {
+		putchar(v >= (1ul << 63) ? '1' : '0');
+		v <<= 1;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s events.bin\n", argv[0]);
+		return 1;
+	}
+	FILE* f = fopen(argv[1], "rb");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	// rings are drained one after the other, so records come back in
+	// time order only after a sort.
+	std::vector<Record> records;
+	EventLog::Header h;
+	while (fread(&h, sizeof(h), 1, f) == 1) {
+		Record r;
+		r.header = h;
+		r.payload.resize((sizeof(h) + h.length + 7) / 8 * 8 - sizeof(h) + 1);
+		if (fread(&r.payload[0], 1, r.payload.size() - 1, f) != r.payload.size() - 1)
+			break;
+		records.push_back(r);
+	}
+	std::stable_sort(records.begin(), records.end(), by_time);
+
+	uint64_t started = 0;
+	int guesses = 0;
+	for (int i = 0; i < records.size(); i++) {
+		const EventLog::Header& h = records[i].header;
+		const char* payload = &records[i].payload[0];
+		long ms = started ? (h.usec - started) / 1000 : 0;
+		switch (h.type) {
+		case EventLog::CHALLENGE: {
+			started = h.usec;
+			guesses = 0;
+			int32_t size;
+			memcpy(&size, payload, 4);
+			const char* id = payload + 4;
+			const char* ops = id + strlen(id) + 1;
+			printf("Challenge ACCEPTED:\nid: %s\nsize: %d\noperators: %s\n", id, size, ops);
+			break;
+		}
+		case EventLog::EVAL: {
+			Val v[2];
+			memcpy(v, payload, sizeof(v));
+			printf("  ");
+			print_bits(v[0]);
+			printf(" -> ");
+			print_bits(v[1]);
+			printf("\n");
+			break;
+		}
+		case EventLog::CANDIDATE: {
+			int64_t count;
+			int32_t size;
+			memcpy(&count, payload, 8);
+			memcpy(&size, payload + 8, 4);
+			printf("??? %6lu ms  %9ld: [%d] %s     \n", ms, (long)count, size, payload + 12);
+			break;
+		}
+		case EventLog::GUESS: {
+			const char* status = payload;
+			const char* program = status + strlen(status) + 1;
+			printf("%6d: %s\nguess done at %lu ms\nguess response:\n{\n   \"status\" : \"%s\"\n}\n",
+				++guesses, program, ms, status);
+			break;
+		}
+		case EventLog::TIMING: {
+			int64_t at;
+			memcpy(&at, payload, 8);
+			printf("%s at %ld ms\n", payload + 8, (long)at);
+			break;
+		}
+		default:
+			printf("unknown record %d of %d bytes\n", h.type, h.length);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+#endif
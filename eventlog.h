@@ -0,0 +1,43 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include "gen2.h"
+
+#include <stdint.h>
+
+// Typed binary trace records instead of printf. Every thread writes into
+// a ring of its own without locks; a background thread drains the rings
+// into the file. A full ring drops the record rather than stall the
+// search. eventlog.cc built with -DEVENTMAIN prints a log the way the
+// old text traces looked.
+class EventLog
+{
+public:
+	enum Type { CHALLENGE = 1, EVAL, CANDIDATE, GUESS, TIMING };
+
+	struct Header {
+		uint16_t type;
+		uint16_t length; // of the payload, records are padded to 8 bytes
+		uint32_t thread;
+		uint64_t usec;
+	};
+
+	// starts the flush thread, false if the file can't be written.
+	static bool open(const char* path);
+	// writes out what is left.
+	static void close();
+
+	static void challenge(const string& id, int size, const string& operators);
+	static void eval(Val in, Val out);
+	// a program the search got to, e.g. every few million.
+	static void candidate(long count, int size, const string& program);
+	static void guess(const string& program, const string& status);
+	static void timing(const char* label, long ms);
+
+	static long dropped();
+
+private:
+	static void write(int type, const void* payload, int length);
+};
+
+#endif
@@ -1,14 +1,26 @@
 #include "gen2.h"
+#include "rules.h"
+#include "goal.h"
+#include "partition.h"
+#include "mcmc.h"
+#include "bestfirst.h"
+#include "iofeatures.h"
+#include "bitsynth.h"
+#include "model.h"
+#include "eventlog.h"
+#include "telemetry.h"
 
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <sys/time.h>
 #include <sstream>
 #include <string>
 #include <list>
 #include <utility>
+#include <vector>
 
 int Expr::arity(Op op)
 {
@@ -47,6 +59,94 @@ int Expr::arity()
 	return arity(op);
 }
 
+Val Expr::apply(Op op, Val a, Val b, Val c)
+{
+    switch (op) {
+    case NOT:   return ~a;
+    case SHL1:  return a << 1;
+    case SHR1:  return a >> 1;
+    case SHR4:  return a >> 4;
+    case SHR16: return a >> 16;
+
+    case PLUS: return a + b;
+    case AND:  return a & b;
+    case OR:   return a | b;
+    case XOR:  return a ^ b;
+
+    case IF0:  return a == 0 ? b : c;
+
+    default:
+        fprintf(stderr, "Error: can't apply op %d\n", op);
+        ASSERT(0);
+    }
+    return 0;
+}
+
+KnownBits KnownBits::apply(Op op, const KnownBits& a, const KnownBits& b, const KnownBits& c)
+{
+	KnownBits r = top();
+    switch (op) {
+    case C0:    return exact(0);
+    case C1:    return exact(1);
+
+    case NOT:   r.zero = a.one; r.one = a.zero; break;
+    case SHL1:  r.zero = (a.zero << 1) | 1; r.one = a.one << 1; break;
+    case SHR1:  r.zero = (a.zero >> 1) | ~(~0ul >> 1); r.one = a.one >> 1; break;
+    case SHR4:  r.zero = (a.zero >> 4) | ~(~0ul >> 4); r.one = a.one >> 4; break;
+    case SHR16: r.zero = (a.zero >> 16) | ~(~0ul >> 16); r.one = a.one >> 16; break;
+
+    case AND:  r.zero = a.zero | b.zero; r.one = a.one & b.one; break;
+    case OR:   r.zero = a.zero & b.zero; r.one = a.one | b.one; break;
+    case XOR: {
+    	Val known = a.known() & b.known();
+    	r.one = (a.one ^ b.one) & known;
+    	r.zero = ~(a.one ^ b.one) & known;
+    	break;
+    }
+    case PLUS: {
+    	// bits are known where both operands and the incoming carry are known.
+    	Val max_sum = ~a.zero + ~b.zero;
+    	Val min_sum = a.one + b.one;
+    	Val carry_zero = ~(max_sum ^ a.zero ^ b.zero);
+    	Val carry_one = min_sum ^ a.one ^ b.one;
+    	Val known = a.known() & b.known() & (carry_zero | carry_one);
+    	r.zero = ~max_sum & known;
+    	r.one = min_sum & known;
+    	break;
+    }
+
+    case IF0:
+    	if (a.one)
+    		return c;
+    	if (a.zero == ~0ul)
+    		return b;
+    	r.zero = b.zero & c.zero;
+    	r.one = b.one & c.one;
+    	break;
+
+    default:
+        // fold is handled by the caller, its result is the lambda's one.
+        break;
+    }
+    return r;
+}
+
+// structural order, used to keep operands of commutative ops canonical.
+int Expr::compare(Expr* e)
+{
+	if (op != e->op)
+		return op < e->op ? -1 : 1;
+	if (op == VAR && var != e->var)
+		return var < e->var ? -1 : 1;
+	int n = arity();
+	for (int i = 0; i < n; i++) {
+		int c = opnd[i]->compare(e->opnd[i]);
+		if (c)
+			return c;
+	}
+	return 0;
+}
+
 Val Expr::eval(Context* ctx)
 {
 	if (flags & F_CONST)
@@ -149,18 +249,50 @@ Val Expr::run(Val input)
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
+// default order in which ops are tried at every position.
+static const Op gen_order[] = {
+	IF0, FOLD, C0, C1, VAR, NOT, SHL1, SHR1, SHR4, SHR16, PLUS, OR, XOR, AND
+};
+
 Arena::Arena()
 {
 //	memset(arena, 0, sizeof(arena));
 	optimize_ = true;
 	callback_ = NULL;
 	no_more_fold_ = false;
+	set_order(gen_order, sizeof(gen_order) / sizeof(*gen_order));
+	for (int i = 0; i < 3; i++)
+		var_order_[i] = i;
+	model_ = NULL;
+}
+
+void Arena::set_order(const Op* ops, int n)
+{
+	bool seen[MAX_OP] = { false };
+	order_size_ = 0;
+	for (int i = 0; i < n; i++) {
+		if (!seen[ops[i]])
+			order_[order_size_++] = ops[i];
+		seen[ops[i]] = true;
+	}
+	for (int i = 0; i < sizeof(gen_order) / sizeof(*gen_order); i++) {
+		if (!seen[gen_order[i]])
+			order_[order_size_++] = gen_order[i];
+		seen[gen_order[i]] = true;
+	}
+}
+
+void Arena::set_var_order(const int* vars)
+{
+	for (int i = 0; i < 3; i++)
+		var_order_[i] = vars[i];
 }
 
 void Arena::generate(int size, int valence, int args)
 {
 //	printf("generate %d %d %d\n", size, valence, args);
 	count_ = 0;
+	known_pruned_ = 0;
 	optimize_ = true;
 	int min_size = valence + 1;
 	allowed_ops_.add(C0);
@@ -184,54 +316,28 @@ void Arena::generate(int size, int valence, int args)
 void Arena::gen(int left_ops, int valence)
 {
 //	printf("gen %d %d\n", left_ops, valence);
-	int max_valence = valence_ + (left_ops - 1) * 2;
-	int min_valence = valence_ - (left_ops - 1);
-
-	if (allowed_ops_.has(IF0) && valence >= 3) {
-    	Expr* cond_opnd = peep_arg(0);
-    	if (!optimize_ || !(cond_opnd->flags & Expr::F_CONST))
-    	    try_emit(IF0, left_ops, valence);
-    }
-
-    // fold consumes at least 3 ops: fold, lambda, and its expr.
-	int fold_max_valence = valence_ + (left_ops - 3) * 2;
-	int fold_min_valence = valence_ - (left_ops - 3);
-	if (fold_min_valence <= valence - 1 && valence - 1 <= fold_max_valence && valence >= 2) {
-    	emit_fold();
-    }
-
-	try_emit(C0, left_ops, valence);
-	try_emit(C1, left_ops, valence);
-    try_emit(VAR, left_ops, valence);
-
-    if (valence >= 1) {
-		Expr* opnd = peep_arg(0);
-		if (!optimize_ || opnd->op != NOT) {
-		    try_emit(NOT, left_ops, valence);
-	    }
-	    // Do not shift 0
-		if (!optimize_ || !opnd->is_const(0)) {
-	    	try_emit(SHL1, left_ops, valence);
-	    }
-	    if (!optimize_ || !opnd->is_const(0) && !opnd->is_const(1)) {
-	    	try_emit(SHR1, left_ops, valence);
-	    	try_emit(SHR4, left_ops, valence);
-	    	try_emit(SHR16, left_ops, valence);
-	    }
+	const Op* order = order_;
+	int order_size = order_size_;
+	if (model_) {
+		const Op* learnt = model_->order(arena_ptr ? arena[arena_ptr - 1].op : DUMMY_OP, left_ops);
+		if (learnt) {
+			order = learnt;
+			order_size = OrderModel::NUM_OPS;
+		}
 	}
-
-	if (valence >= 2) {
-		Expr* opnd1 = peep_arg(0);
-		Expr* opnd2 = peep_arg(1);
-		if (!optimize_ || !opnd1->is_const(0) && !opnd2->is_const(0)) {
-	    	try_emit(PLUS, left_ops, valence);
-	    	try_emit(OR, left_ops, valence);
-	    	try_emit(XOR, left_ops, valence);
-	    	try_emit(AND, left_ops, valence);
+	for (int i = 0; i < order_size; i++) {
+		Op op = order[i];
+		if (op != FOLD) {
+			try_emit(op, left_ops, valence);
+			continue;
+		}
+	    // fold consumes at least 3 ops: fold, lambda, and its expr.
+		int fold_max_valence = valence_ + (left_ops - 3) * 2;
+		int fold_min_valence = valence_ - (left_ops - 3);
+		if (fold_min_valence <= valence - 1 && valence - 1 <= fold_max_valence && valence >= 2) {
+	    	emit_fold();
 	    }
 	}
-
-
 }
 
 Expr* Arena::peep_arg(int arg)
@@ -247,12 +353,6 @@ void Arena::try_emit(Op op, int left_ops, int valence)
     if (!allowed_ops_.has(op))
     	return;
 
-    if (left_ops == 1) {
-    	if (op == SHL1  && (properties_ & NO_TOP_SHL1)) return;
-    	if (op == SHR1  && (properties_ & NO_TOP_SHR1)) return;
-    	if (op == SHR4  && (properties_ & NO_TOP_SHR4)) return;
-    	if (op == SHR16 && (properties_ & NO_TOP_SHR16)) return;
-    }
     int arity = Expr::arity(op);
 
     // ensure we don't miss a fold if it's required
@@ -270,9 +370,17 @@ void Arena::try_emit(Op op, int left_ops, int valence)
     }
 
 	if (min_valence <= valence - arity + 1 && valence - arity + 1 <= max_valence && valence >= arity) {
+		if (optimize_ && arity > 0) {
+			Expr* args[3];
+			for (int i = 0; i < arity; i++)
+				args[i] = peep_arg(i);
+			if (Rules::reject(op, args, allowed_ops_))
+				return;
+		}
 		if (op == VAR) {
-			for (int i = 0; i < num_vars_; i++)
-				emit(VAR, i);
+			for (int i = 0; i < 3; i++)
+				if (var_order_[i] < num_vars_)
+					emit(VAR, var_order_[i]);
 		} else {
 	        emit(op);
 	    }
@@ -301,12 +409,20 @@ void Arena::emit(Op op, int var)
 bool Arena::complete(Expr* e, int size)
 {
 	count_++;
+	Telemetry::add(Telemetry::COMPLETED);
+	// the top level result must agree with the observed outputs.
+	if (!observed_.admits(e->bits)) {
+		known_pruned_++;
+		Telemetry::add(Telemetry::PRUNED_BITS);
+		return false;
+	}
 	return callback_ ? !callback_->action(e, size) : false;
 }
 
 int Arena::push_op(Op op, int var)
 {
 	int my_ptr = arena_ptr++;
+	Telemetry::add(Telemetry::PUSH + op);
 //	printf("push_op %d -> [%d]: ", op, my_ptr);
 	Expr& e = arena[my_ptr];
 	memset(&e, 0, sizeof(Expr));
@@ -331,6 +447,16 @@ int Arena::push_op(Op op, int var)
     if (op == FOLD) {
 	    e.opnd[2] = fold_lambda_;
 	    fold_lambda_->parent = &e;
+	    e.bits = fold_lambda_->bits;
+	} else if (op == VAR) {
+		// x1 of a fold lambda is a byte
+		e.bits = KnownBits::top();
+		if (num_vars_ == 3 && var == 1)
+			e.bits.zero = ~0xfful;
+	} else {
+		KnownBits none = KnownBits::top();
+		e.bits = KnownBits::apply(op, arity > 0 ? e.opnd[0]->bits : none,
+			arity > 1 ? e.opnd[1]->bits : none, arity > 2 ? e.opnd[2]->bits : none);
 	}
 
     if (const_expr) {
@@ -344,6 +470,7 @@ int Arena::push_op(Op op, int var)
 	    }
     	// eval before setting the flag, otherwise it won't really do eval.
     	e.flags |= Expr::F_CONST;
+    	e.bits = KnownBits::exact(e.val);
     }
 
 	valents[valents_ptr++] = my_ptr;
@@ -385,15 +512,19 @@ void Arena::emit_fold()
     fold_lambda.set_callback(this);
     fold_lambda.no_more_fold_ = true; // disable inner folds
     fold_lambda.allowed_ops_ = allowed_ops_;
+    fold_lambda.set_order(order_, order_size_);
+    fold_lambda.set_var_order(var_order_);
+    fold_lambda.set_model(model_);
     fold_lambda.generate(max_size, 1, 3);
     no_more_fold_ = false;
 }
 
 bool Arena::action(Expr* expr, int size)
 {
-	if (optimize_ && (expr->is_const() || expr->is_var(0)))
+	if (optimize_ && Rules::reject_lambda(expr))
 		return true;
 
+	Telemetry::add(Telemetry::FOLD_LAMBDAS);
     arena_ptr += size;
 	fold_lambda_ = expr;
 	emit(FOLD);
@@ -456,7 +587,7 @@ bool Printer::action(Expr* e, int size)
 #ifdef GEN2
 	printf("%9d: [%2d] %s\n", cnt, size, e->program().c_str());
 #else
-	if ((cnt & 0x3fffff) == 0) printf("%9d: [%2d] %s\n", cnt, size, e->program().c_str());
+	if ((cnt & 0x3fffff) == 0) EventLog::candidate(cnt, size, e->program());
 #endif
 	return true;
 }
@@ -476,9 +607,11 @@ bool Verifier::action(Expr* program, int size)
 		Val actual = program->run((*it).first);
 		if (actual != (*it).second) {
 //			printf("%s failed 0x%lx -> 0x%lx\n", program->program().c_str(), (*it).first, actual);
+			Telemetry::add(it == pairs.begin() ? Telemetry::VERIFY_FIRST : Telemetry::VERIFY_LATER);
 			return true;
 		}
     }
+	Telemetry::add(Telemetry::VERIFY_PASSED);
     printf("--- %6d: %s\n", ++count, program->program().c_str());
 #if 0
 	for (Pairs::iterator it = pairs.begin(); it != pairs.end(); ++it) {
@@ -488,28 +621,155 @@ bool Verifier::action(Expr* program, int size)
     return false;
 }
 
-void Generator::generate(int size)
+bool Verifier::poll()
+{
+	return !deadline_ || now_ms() < deadline_;
+}
+
+long Verifier::now_ms()
 {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000l + tv.tv_usec / 1000;
+}
+
+bool Generator::generate(int size)
+{
+	Verifier* verifier = dynamic_cast<Verifier*>(callback_);
+	// tfold and bonus keep bits in place no more than if0 and fold do.
+	if ((unlikely_ops_.set_ & allowed_ops_.set_) && !mode_tfold_ && !mode_bonus_) {
+		Generator first(*this);
+		first.allowed_ops_.set_ &= ~unlikely_ops_.set_;
+		first.unlikely_ops_ = OpSet();
+		// only Arena, the other stages run once below with all the ops.
+		first.mode_partition_ = false;
+		first.mode_bitsynth_ = false;
+		first.mode_goal_ = false;
+		first.mode_best_first_ = false;
+		first.mode_mcmc_ = false;
+		printf("first pass without ops 0x%x\n", unlikely_ops_.set_ & allowed_ops_.set_);
+		// a quarter of the time left, Arena alone can't finish big sizes.
+		long deadline = verifier ? verifier->deadline() : 0;
+		if (deadline)
+			verifier->set_deadline(Verifier::now_ms() + (deadline - Verifier::now_ms()) / 4);
+		bool stop = first.generate(size);
+		if (deadline) {
+			// out of its share only, the stages below get the rest.
+			if (Verifier::now_ms() >= verifier->deadline())
+				stop = false;
+			verifier->set_deadline(deadline);
+		}
+		if (stop || (verifier && !verifier->settle()))
+			return true;
+	}
+
+	// every stage below settles what it leaves held before the next one.
+	if (mode_partition_ && verifier && !mode_tfold_ && (mode_bonus_ || allowed_ops_.has(IF0))) {
+		PartitionSolver ps;
+		ps.set_callback(verifier);
+		ps.set_bonus(mode_bonus_);
+		ps.allowed_ops_ = allowed_ops_;
+		bool done = ps.generate(size);
+		printf("partition steps=%ld\n", ps.steps_);
+		if (done || !verifier->settle())
+			return true;
+	}
+
+	if (mode_bitsynth_ && verifier && !mode_tfold_ && !mode_bonus_ && BitSynth::covers(allowed_ops_)) {
+		BitSynth bs;
+		bs.set_callback(verifier);
+		bs.allowed_ops_ = allowed_ops_;
+		bool done = bs.generate(size);
+		printf("bitsynth checked=%ld\n", bs.checked_);
+		if (done || !verifier->settle())
+			return true;
+	}
+
+	if (mode_goal_ && verifier && !mode_tfold_ && !mode_bonus_ && !allowed_ops_.has(FOLD)) {
+		GoalSearch gs;
+		gs.set_callback(verifier);
+		gs.allowed_ops_ = allowed_ops_;
+		bool done = gs.generate(size);
+		printf("goal search steps=%ld mitm lookups=%ld\n", gs.steps_, gs.mitm_lookups_);
+		if (done || !verifier->settle())
+			return true;
+	}
+
+	if (mode_best_first_ && verifier && !mode_tfold_ && !allowed_ops_.has(FOLD)) {
+		BestFirst bf;
+		bf.set_callback(verifier);
+		bf.allowed_ops_ = allowed_ops_;
+		bool done = bf.generate(size);
+		printf("best first expanded=%ld pruned=%ld trimmed=%ld\n", bf.expanded_, bf.pruned_, bf.trimmed_);
+		if (done || !verifier->settle())
+			return true;
+	}
+
+	if (mode_mcmc_ && verifier && !mode_tfold_ && !allowed_ops_.has(FOLD) && size > 16) {
+		McmcSearch ms;
+		ms.set_callback(verifier);
+		ms.allowed_ops_ = allowed_ops_;
+		bool done = ms.generate(size);
+		printf("mcmc proposals=%ld accepted=%ld restarts=%ld\n", ms.proposals_, ms.accepted_, ms.restarts_);
+		if (done || !verifier->settle())
+			return true;
+	}
+
+	// an empty order leaves Arena's default one.
+	Op order[MAX_OP];
+	int order_size = 0;
+	int vars[3] = { 0, 1, 2 };
+	if (mode_features_ && verifier) {
+		std::vector<Val> in, out;
+		const Verifier::Pairs& pairs = verifier->get_pairs();
+		for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+			in.push_back(it->first);
+			out.push_back(it->second);
+		}
+		Features f;
+		f.extract(&in[0], &out[0], in.size());
+		f.print();
+		order_size = f.order(allowed_ops_, order);
+		f.var_order(vars);
+	}
+
+	bool done;
 	if (mode_tfold_) {
 		ArenaTfold a;
 		a.set_callback(callback_);
 		a.allowed_ops_ = allowed_ops_;
+		a.set_observed(observed_);
+		a.set_order(order, order_size);
+		a.set_var_order(vars);
+		a.set_model(model_);
 		a.generate(size);
-		printf("count=%d\n", a.count_);
+		done = a.done_;
+		printf("count=%d known bits pruned=%d\n", a.count_, a.known_pruned_);
 	} else if (mode_bonus_) {
 		ArenaBonus a;
 		a.set_callback(callback_);
 		a.allowed_ops_ = allowed_ops_;
+		a.set_observed(observed_);
+		a.set_order(order, order_size);
+		a.set_var_order(vars);
+		a.set_model(model_);
 		a.generate(size);
-		printf("count=%d\n", a.count_);
+		done = a.done_;
+		printf("count=%d known bits pruned=%d\n", a.count_, a.known_pruned_);
 	} else {
 		Arena a;
 		a.set_callback(callback_);
-		a.set_properties(properties_);
 		a.allowed_ops_ = allowed_ops_;
+		a.set_observed(observed_);
+		a.set_order(order, order_size);
+		a.set_var_order(vars);
+		a.set_model(model_);
 		a.generate(size);
-		printf("count=%d\n", a.count_);
+		done = a.done_;
+		printf("count=%d known bits pruned=%d\n", a.count_, a.known_pruned_);
 	}
+	Telemetry::print_rules();
+	return done;
 }
 
 #ifdef GEN2
@@ -1,3 +1,6 @@
+#ifndef GEN2_H
+#define GEN2_H
+
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -13,13 +16,6 @@ using std::string;
 
 typedef uint64_t Val;
 
-enum {
-    NO_TOP_SHL1  = 0x01,
-    NO_TOP_SHR1  = 0x02,
-    NO_TOP_SHR4  = 0x04,
-    NO_TOP_SHR16 = 0x08
-};
-
 class Context
 {
 public:
@@ -75,6 +71,36 @@ public:
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Bits of a value known for any input: must-be-0 and must-be-1 masks.
+struct KnownBits
+{
+	static KnownBits top() { KnownBits k; k.zero = 0; k.one = 0; return k; }
+	static KnownBits exact(Val v) { KnownBits k; k.zero = ~v; k.one = v; return k; }
+	static KnownBits apply(Op op, const KnownBits& a, const KnownBits& b, const KnownBits& c);
+
+	Val known() const { return zero | one; }
+
+	Val zero;
+	Val one;
+};
+
+// Bits seen in the observed outputs. A program whose known bits contradict
+// any of the outputs can be dropped without running it.
+struct Observed
+{
+	Observed() : any_one(0), any_zero(0) {}
+
+	void add(Val out) { any_one |= out; any_zero |= ~out; }
+	bool admits(const KnownBits& k) const { return !(k.zero & any_one) && !(k.one & any_zero); }
+
+	Val any_one;
+	Val any_zero;
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
 class Expr
 {
 public:
@@ -85,6 +111,8 @@ public:
 
     int arity();
     static int arity(Op op);
+    static Val apply(Op op, Val a, Val b = 0, Val c = 0);
+    int compare(Expr* e);
     string code();
     string program();
     bool is_var(int id) { return op == VAR && var == id; }
@@ -98,12 +126,15 @@ public:
 	Expr* parent;
 	Expr* opnd[3];
 	int   flags;
+	KnownBits bits;
 	union {
 	    Val   val; // for const
 	    int   var; // if op is VAR
 	};
 };
 
+class OrderModel;
+
 class Callback
 {
 public:
@@ -118,7 +149,7 @@ public:
 	Arena();
 
     void set_callback(Callback* c) { callback_ = c; }
-    void set_properties(int p) { properties_ = p; }
+    void set_observed(const Observed& o) { observed_ = o; }
     void generate(int size, int valence = 1, int args = 1);
 	void gen(int left_ops, int valence);
 
@@ -134,6 +165,11 @@ public:
 
     void allow_all();
     void add_allowed_op(Op op);
+    // ops missing from the list are still tried, after the listed ones.
+    void set_order(const Op* ops, int n);
+    void set_var_order(const int* vars);
+    // learnt orders take over the one above where the model knows better.
+    void set_model(const OrderModel* m) { model_ = m; }
    
     virtual bool complete(Expr* e, int size);
 
@@ -149,9 +185,14 @@ public:
     bool no_more_fold_;
     int valence_;
     bool done_;
-    int properties_;
+    Observed observed_;
+    int known_pruned_;
 
     OpSet allowed_ops_;
+    Op order_[MAX_OP];
+    int order_size_;
+    int var_order_[3];
+    const OrderModel* model_;
 
     int valents[30];
     int valents_ptr;
@@ -192,33 +233,60 @@ public:
 class Verifier: public Callback
 {
 public:
-	Verifier() : count(0) {}
+	typedef std::list< std::pair<Val, Val> > Pairs;
+
+	Verifier() : count(0), deadline_(0) {}
 	void add(Val input, Val output);
+	const Pairs& get_pairs() const { return pairs; }
 
 	virtual bool action(Expr* e, int size);
 
-protected:
-	typedef std::list< std::pair<Val, Val> > Pairs;
+	// when every search should give up, in now_ms() time, 0 for never.
+	void set_deadline(long ms) { deadline_ = ms; }
+	long deadline() const { return deadline_; }
+	// searches going a while without a candidate call this every so
+	// often; false when they should give up.
+	virtual bool poll();
+	// for candidates held back to be dealt with, called after every stage
+	// that found nothing and by stages that learn from each candidate;
+	// false to stop the search.
+	virtual bool settle() { return poll(); }
 
+	// wall clock ms, as the server counts.
+	static long now_ms();
+
+protected:
 	Pairs pairs;
 	int count;
+	long deadline_;
 };
 
 class Generator
 {
 public:
-	Generator() : callback_(NULL), mode_bonus_(false), mode_tfold_(false), properties_(0) {}
+	Generator() : callback_(NULL), mode_bonus_(false), mode_tfold_(false), mode_goal_(false), mode_partition_(false), mode_best_first_(false), mode_mcmc_(false), mode_features_(false), mode_bitsynth_(false), model_(NULL) {}
 	void set_callback(Callback* c) { callback_ = c; }
-	void generate(int size);
+	// true if the callback asked to stop.
+	bool generate(int size);
 
-    void set_properties(int p) { properties_ = p; }
+    void add_output(Val out) { observed_.add(out); }
     void add_allowed_op(Op op) { allowed_ops_.add(op); }
 
     bool mode_bonus_;
     bool mode_tfold_;
+    bool mode_goal_; // try GoalSearch first on fold-free problems
+    bool mode_partition_; // try PartitionSolver first on bonus and if0 problems
+    bool mode_best_first_; // try BestFirst on fold-free problems
+    bool mode_mcmc_; // try McmcSearch on fold-free problems too large for Arena
+    bool mode_features_; // order Arena's ops by the I/O features
+    bool mode_bitsynth_; // try BitSynth on bitwise and shift only problems
 
     OpSet allowed_ops_;
-    int properties_;
+    OpSet unlikely_ops_; // left out of a first pass, see Probe
+    Observed observed_;
+    const OrderModel* model_; // learnt op orders for Arena, if any
 
     Callback* callback_;
 };
+
+#endif
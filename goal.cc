@@ -0,0 +1,302 @@
+#include "goal.h"
+#include "mitm.h"
+
+#include <stdio.h>
+
+GoalSearch::GoalSearch()
+{
+	verifier_ = NULL;
+	max_steps_ = 20000000;
+	steps_ = 0;
+	mitm_lookups_ = 0;
+	bank_size_ = 0;
+	next_poll_ = 0;
+	expired_ = false;
+}
+
+void GoalSearch::reset()
+{
+	std::vector<Val> inputs;
+	outputs_.clear();
+	Bank::pick_pairs(verifier_->get_pairs(), &inputs, &outputs_);
+	bank_.allowed_ops_ = allowed_ops_;
+	bank_.set_inputs(inputs);
+	bank_.set_deadline(verifier_->deadline());
+	bank_.grow(bank_size_);
+	failed_.clear();
+	pool_.clear();
+}
+
+bool GoalSearch::generate(int size)
+{
+	bank_size_ = size - 1;
+	for (;;) {
+		size_t seen = verifier_->get_pairs().size();
+		reset();
+		printf("goal search: bank complete up to %d, %d terms\n", bank_.complete_size(), bank_.count());
+
+		// goals are over the bank's pairs, the verifier checks the rest.
+		Goal g;
+		g.want = outputs_;
+		g.care.assign(outputs_.size(), ~0ul);
+
+		// a bank term itself, or meet in the middle on the top op, before
+		// going deeper. Both are a single pass over the bank.
+		int t = bank_.find(&g.want[0]);
+		Expr* e = t >= 0 ? bank_.build(t, &pool_) : NULL;
+		if (!e) {
+			MitmSolver mitm(&bank_);
+			mitm.allowed_ops_ = allowed_ops_;
+			e = mitm.solve(&g.want[0], size - 1, &pool_);
+			mitm_lookups_ += mitm.lookups_ + mitm.joins_;
+		}
+
+		for (int n = 1; !e && n < size && !spent(); n++)
+			e = solve(g, n);
+		if (!e)
+			return false;
+		if (!verifier_->action(e, ExprPool::size(e) + 1))
+			return true;
+		// a held candidate teaches nothing until it is resolved.
+		if (!verifier_->settle())
+			return true;
+		// nothing new learnt from the candidate, leave the rest to Arena.
+		if (verifier_->get_pairs().size() == seen)
+			return false;
+	}
+}
+
+bool GoalSearch::spent()
+{
+	// the clock is read only once in a while.
+	if (steps_ >= next_poll_) {
+		next_poll_ = steps_ + 65536;
+		expired_ = expired_ || !verifier_->poll();
+	}
+	return expired_ || steps_ > max_steps_;
+}
+
+Val GoalSearch::hash(const Goal& g)
+{
+	Val h = 0;
+	int n = g.want.size();
+	for (int i = 0; i < n; i++) {
+		h ^= g.want[i] & g.care[i];
+		h *= 0x9e3779b97f4a7c15ul;
+		h ^= g.care[i] + (h >> 31);
+		h *= 0xbf58476d1ce4e5b9ul;
+	}
+	return h;
+}
+
+bool GoalSearch::matches(int t, const Goal& g) const
+{
+	const Val* v = bank_.values(t);
+	int n = g.want.size();
+	for (int i = 0; i < n; i++)
+		if ((v[i] ^ g.want[i]) & g.care[i])
+			return false;
+	return true;
+}
+
+Expr* GoalSearch::solve(const Goal& g, int size)
+{
+	steps_++;
+	if (spent())
+		return NULL;
+
+	Val h = hash(g);
+	std::map<Val, int>::iterator it = failed_.find(h);
+	if (it != failed_.end() && it->second >= size)
+		return NULL;
+
+	Expr* e = solve_leaf(g, size);
+	if (!e && size > bank_.complete_size()) {
+		if (size >= 2)
+			e = solve_unary(g, size);
+		if (!e && size >= 3)
+			e = solve_binary(g, size);
+		if (!e && size >= 4)
+			e = solve_if0(g, size);
+	}
+	if (!e)
+		failed_[h] = size;
+	return e;
+}
+
+// the bank has the smallest term of every value vector up to its complete
+// size, so goals of that size are decided by it alone.
+Expr* GoalSearch::solve_leaf(const Goal& g, int size)
+{
+	int n = g.want.size();
+	bool full = true;
+	bool none = true;
+	for (int i = 0; i < n; i++) {
+		full = full && g.care[i] == ~0ul;
+		none = none && g.care[i] == 0;
+	}
+	if (none)
+		return pool_.make(C0);
+
+	if (full) {
+		int t = bank_.find(&g.want[0]);
+		if (t >= 0 && bank_.term(t).size <= size)
+			return bank_.build(t, &pool_);
+		return NULL;
+	}
+
+	if (size > bank_.complete_size())
+		return NULL;
+	// a scan costs a step per term.
+	int end = bank_.first(size + 1);
+	for (int t = 0; t < end; t++) {
+		if (matches(t, g)) {
+			steps_ += t + 1;
+			return bank_.build(t, &pool_);
+		}
+	}
+	steps_ += end;
+	return NULL;
+}
+
+Expr* GoalSearch::solve_unary(const Goal& g, int size)
+{
+	static const Op unary[] = { NOT, SHL1, SHR1, SHR4, SHR16 };
+	int n = g.want.size();
+	Goal sub;
+	sub.want.resize(n);
+	sub.care.resize(n);
+
+	for (int k = 0; k < sizeof(unary) / sizeof(*unary); k++) {
+		Op op = unary[k];
+		if (!allowed_ops_.has(op))
+			continue;
+		int shift = op == SHR1 ? 1 : op == SHR4 ? 4 : op == SHR16 ? 16 : 0;
+		// bits the op always clears
+		Val cleared = op == SHL1 ? 1 : shift ? ~(~0ul >> shift) : 0;
+		bool ok = true;
+		for (int i = 0; i < n && ok; i++) {
+			Val want = g.want[i] & g.care[i];
+			ok = !(want & cleared);
+			switch (op) {
+			case NOT:  sub.want[i] = ~want; sub.care[i] = g.care[i]; break;
+			case SHL1: sub.want[i] = want >> 1; sub.care[i] = g.care[i] >> 1; break;
+			default:   sub.want[i] = want << shift; sub.care[i] = g.care[i] << shift; break;
+			}
+		}
+		if (!ok)
+			continue;
+		Expr* e = solve(sub, size - 1);
+		if (e)
+			return pool_.make(op, e);
+		if (spent())
+			return NULL;
+	}
+	return NULL;
+}
+
+Expr* GoalSearch::solve_binary(const Goal& g, int size)
+{
+	static const Op binary[] = { XOR, AND, OR, PLUS };
+	int n = g.want.size();
+	Goal sub;
+	sub.want.resize(n);
+	sub.care.resize(n);
+
+	// plus can only be undone when the care bits are a low prefix.
+	bool low_prefix = true;
+	for (int i = 0; i < n; i++)
+		low_prefix = low_prefix && !(g.care[i] & (g.care[i] + 1));
+
+	// all of them commute, so the smaller operand comes from the bank.
+	int max_a = (size - 1) / 2;
+	if (max_a > bank_.complete_size())
+		max_a = bank_.complete_size();
+	for (int a = 0; a < bank_.first(max_a + 1); a++) {
+		const Val* va = bank_.values(a);
+		int b_size = size - 1 - bank_.term(a).size;
+		for (int k = 0; k < sizeof(binary) / sizeof(*binary); k++) {
+			Op op = binary[k];
+			if (!allowed_ops_.has(op) || (op == PLUS && !low_prefix))
+				continue;
+			bool ok = true;
+			for (int i = 0; i < n && ok; i++) {
+				Val want = g.want[i] & g.care[i];
+				switch (op) {
+				case XOR:
+					sub.want[i] = want ^ va[i];
+					sub.care[i] = g.care[i];
+					break;
+				case AND:
+					ok = !(want & ~va[i]);
+					sub.care[i] = g.care[i] & va[i];
+					sub.want[i] = want & sub.care[i];
+					break;
+				case OR:
+					ok = !(va[i] & g.care[i] & ~want);
+					sub.care[i] = g.care[i] & ~va[i];
+					sub.want[i] = want & sub.care[i];
+					break;
+				default:
+					sub.want[i] = (want - va[i]) & g.care[i];
+					sub.care[i] = g.care[i];
+					break;
+				}
+			}
+			if (!ok)
+				continue;
+			Expr* e = solve(sub, b_size);
+			if (e)
+				return pool_.make(op, bank_.build(a, &pool_), e);
+			if (spent())
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+Expr* GoalSearch::solve_if0(const Goal& g, int size)
+{
+	if (!allowed_ops_.has(IF0))
+		return NULL;
+
+	int n = g.want.size();
+	Goal then_goal, else_goal;
+	then_goal.want = g.want;
+	else_goal.want = g.want;
+	then_goal.care.resize(n);
+	else_goal.care.resize(n);
+
+	int max_c = size - 3;
+	if (max_c > bank_.complete_size())
+		max_c = bank_.complete_size();
+	for (int c = 0; c < bank_.first(max_c + 1); c++) {
+		const Val* vc = bank_.values(c);
+		int zeros = 0;
+		for (int i = 0; i < n; i++) {
+			bool zero = vc[i] == 0;
+			zeros += zero;
+			then_goal.care[i] = zero ? g.care[i] : 0;
+			else_goal.care[i] = zero ? 0 : g.care[i];
+		}
+		// a condition that doesn't split the inputs is useless.
+		if (zeros == 0 || zeros == n)
+			continue;
+
+		int left = size - 1 - bank_.term(c).size;
+		Expr* t = NULL;
+		for (int st = 1; st < left && !t; st++)
+			t = solve(then_goal, st);
+		if (!t) {
+			if (spent())
+				return NULL;
+			continue;
+		}
+		Expr* e = solve(else_goal, left - ExprPool::size(t));
+		if (e)
+			return pool_.make(IF0, bank_.build(c, &pool_), t, e);
+		if (spent())
+			return NULL;
+	}
+	return NULL;
+}
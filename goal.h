@@ -0,0 +1,62 @@
+#ifndef GOAL_H
+#define GOAL_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <map>
+#include <vector>
+
+// Top-down search that pushes the required outputs down the tree. Every
+// op either transforms the goal for its operand (not, shifts) or takes one
+// operand from the bank and derives the goal of the other (xor, and, or,
+// plus, the condition of if0). Goals that can't be met are dropped at once.
+// Each round starts with a meet in the middle pass on the top op. Only
+// fold-free programs are searched.
+class GoalSearch
+{
+public:
+	GoalSearch();
+
+	void set_callback(Verifier* v) { verifier_ = v; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+	void set_max_steps(long n) { max_steps_ = n; }
+
+	// true if the callback asked to stop.
+	bool generate(int size);
+
+	OpSet allowed_ops_;
+	long steps_;
+	long mitm_lookups_;
+
+private:
+	// required value of a program on every input, only care bits matter.
+	struct Goal {
+		std::vector<Val> want;
+		std::vector<Val> care;
+	};
+
+	void reset();
+	Expr* solve(const Goal& g, int size);
+	Expr* solve_leaf(const Goal& g, int size);
+	Expr* solve_unary(const Goal& g, int size);
+	Expr* solve_binary(const Goal& g, int size);
+	Expr* solve_if0(const Goal& g, int size);
+
+	bool matches(int t, const Goal& g) const;
+	static Val hash(const Goal& g);
+	// out of steps or past the verifier's deadline.
+	bool spent();
+
+	Verifier* verifier_;
+	Bank bank_;
+	ExprPool pool_;
+	std::map<Val, int> failed_; // goal hash -> size it is known to fail at
+	std::vector<Val> outputs_;  // on the bank's inputs
+	long max_steps_;
+	int bank_size_;
+	long next_poll_;
+	bool expired_;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "iofeatures.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// same order as Arena's default one, used as the base score.
+static const Op base_order[] = {
+	IF0, FOLD, C0, C1, VAR, NOT, SHL1, SHR1, SHR4, SHR16, PLUS, OR, XOR, AND
+};
+
+Features::Features()
+{
+	best_shift_ = 0;
+	best_not_ = false;
+	shift_match_ = 0;
+	dep_left_ = dep_right_ = dep_same_ = dep_none_ = 0;
+	max_right_ = 0;
+	low_bytes_ = 0;
+	monotone_ = 0;
+	carry_ = 0;
+	density_ = 0;
+}
+
+// wrong bits of (not) (shift x s) summed over all pairs.
+static long shifted_distance(const Val* in, const Val* out, int n, int s, bool neg)
+{
+	long d = 0;
+	int j = 0;
+	int amount = s > 0 ? s : -s;
+#if defined(__AVX2__)
+	__m128i cnt = _mm_cvtsi32_si128(amount);
+	__m256i flip = _mm256_set1_epi64x(neg ? -1 : 0);
+	for (; j + 4 <= n; j += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(in + j));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(out + j));
+		x = s > 0 ? _mm256_sll_epi64(x, cnt) : _mm256_srl_epi64(x, cnt);
+		__m256i v = _mm256_xor_si256(_mm256_xor_si256(x, flip), y);
+		d += __builtin_popcountll(_mm256_extract_epi64(v, 0)) + __builtin_popcountll(_mm256_extract_epi64(v, 1))
+			+ __builtin_popcountll(_mm256_extract_epi64(v, 2)) + __builtin_popcountll(_mm256_extract_epi64(v, 3));
+	}
+#elif defined(__SSE2__)
+	__m128i cnt = _mm_cvtsi32_si128(amount);
+	__m128i flip = _mm_set1_epi64x(neg ? -1 : 0);
+	for (; j + 2 <= n; j += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(in + j));
+		__m128i y = _mm_loadu_si128((const __m128i*)(out + j));
+		x = s > 0 ? _mm_sll_epi64(x, cnt) : _mm_srl_epi64(x, cnt);
+		__m128i v = _mm_xor_si128(_mm_xor_si128(x, flip), y);
+		Val lanes[2];
+		_mm_storeu_si128((__m128i*)lanes, v);
+		d += __builtin_popcountll(lanes[0]) + __builtin_popcountll(lanes[1]);
+	}
+#endif
+	for (; j < n; j++) {
+		Val x = s > 0 ? in[j] << amount : in[j] >> amount;
+		d += __builtin_popcountll((neg ? ~x : x) ^ out[j]);
+	}
+	return d;
+}
+
+void Features::extract(const Val* in, const Val* out, int n)
+{
+	if (n == 0)
+		return;
+
+	long best = -1;
+	for (int s = -63; s <= 63; s++) {
+		for (int neg = 0; neg < 2; neg++) {
+			long d = shifted_distance(in, out, n, s, neg);
+			if (best < 0 || d < best) {
+				best = d;
+				best_shift_ = s;
+				best_not_ = neg;
+			}
+		}
+	}
+	shift_match_ = 1 - best / (64.0 * n);
+
+	// one bit per pair for every bit position, then output bit i agrees
+	// with input bit j on popcount(~(out[i] ^ in[j])) pairs.
+	int words = (n + 63) / 64;
+	std::vector<Val> in_bits(64 * words), out_bits(64 * words);
+	for (int j = 0; j < n; j++) {
+		for (int b = 0; b < 64; b++) {
+			in_bits[b * words + j / 64] |= ((in[j] >> b) & 1) << (j % 64);
+			out_bits[b * words + j / 64] |= ((out[j] >> b) & 1) << (j % 64);
+		}
+	}
+	Val last = n % 64 ? (1ul << (n % 64)) - 1 : ~0ul;
+	dep_left_ = dep_right_ = dep_same_ = dep_none_ = 0;
+	max_right_ = 0;
+	for (int i = 0; i < 64; i++) {
+		int ones = 0;
+		for (int w = 0; w < words; w++)
+			ones += __builtin_popcountll(out_bits[i * words + w]);
+		// constant bits say nothing about where they come from.
+		if (ones == 0 || ones == n)
+			continue;
+		int best_j = -1, best_agree = 0;
+		for (int j = 0; j < 64; j++) {
+			int agree = 0;
+			for (int w = 0; w < words; w++) {
+				Val same = ~(out_bits[i * words + w] ^ in_bits[j * words + w]);
+				agree += __builtin_popcountll(w == words - 1 ? same & last : same);
+			}
+			// a negated bit depends on the input just as well.
+			if (n - agree > agree)
+				agree = n - agree;
+			if (agree > best_agree) {
+				best_agree = agree;
+				best_j = j;
+			}
+		}
+		if (best_agree < n * 0.95)
+			dep_none_++;
+		else if (best_j < i)
+			dep_left_++;
+		else if (best_j > i) {
+			dep_right_++;
+			if (best_j - i > max_right_)
+				max_right_ = best_j - i;
+		} else
+			dep_same_++;
+	}
+
+	// density over the bits that vary at all, so that a narrow output
+	// doesn't look sparse.
+	Val any_one = 0, any_zero = 0;
+	for (int j = 0; j < n; j++) {
+		any_one |= out[j];
+		any_zero |= ~out[j];
+	}
+	Val varying = any_one & any_zero;
+
+	int low = 0, carries = 0;
+	long ones = 0;
+	std::vector< std::pair<Val, Val> > sorted;
+	for (int j = 0; j < n; j++) {
+		low += out[j] < (1ul << 16);
+		Val v = out[j] ^ in[j];
+		carries += v && !(v & (v + 1));
+		ones += __builtin_popcountll(out[j] & varying);
+		sorted.push_back(std::make_pair(in[j], out[j]));
+	}
+	std::sort(sorted.begin(), sorted.end());
+	int ordered = 0;
+	for (int j = 1; j < n; j++)
+		ordered += sorted[j - 1].second <= sorted[j].second;
+
+	low_bytes_ = 1.0 * low / n;
+	carry_ = 1.0 * carries / n;
+	monotone_ = n > 1 ? 1.0 * ordered / (n - 1) : 0;
+	density_ = varying ? ones / (1.0 * __builtin_popcountll(varying) * n) : 0.5;
+}
+
+int Features::order(OpSet allowed, Op* ops) const
+{
+	int n = sizeof(base_order) / sizeof(*base_order);
+	double score[MAX_OP];
+	for (int i = 0; i < n; i++)
+		score[base_order[i]] = -i;
+
+	// nearly a copy of the input, if0 and fold are unlikely at the top.
+	if (dep_none_ < 8 && shift_match_ > 0.9) {
+		score[IF0] -= 30;
+		score[FOLD] -= 30;
+	}
+	// a few bits lining up by chance say little.
+	if (dep_right_ > dep_left_ && dep_right_ >= 4) {
+		score[SHR1] += 10;
+		score[SHR4] += 10;
+		score[SHR16] += 10;
+		score[max_right_ >= 16 ? SHR16 : max_right_ >= 4 ? SHR4 : SHR1] += 3;
+	} else if (dep_left_ > dep_right_ && dep_left_ >= 4) {
+		score[SHL1] += 10;
+	}
+	if (best_not_)
+		score[NOT] += 10;
+	if (carry_ > 0.2 || monotone_ > 0.8)
+		score[PLUS] += 10;
+	if (density_ < 0.35)
+		score[AND] += 8;
+	else if (density_ > 0.65)
+		score[OR] += 8;
+	if (dep_left_ + dep_right_ + dep_same_ >= 8)
+		score[VAR] += 5;
+
+	int count = 0;
+	for (int i = 0; i < n; i++)
+		if (Expr::arity(base_order[i]) == 0 || allowed.has(base_order[i]))
+			ops[count++] = base_order[i];
+	for (int i = 1; i < count; i++)
+		for (int j = i; j > 0 && score[ops[j]] > score[ops[j - 1]]; j--)
+			std::swap(ops[j], ops[j - 1]);
+	return count;
+}
+
+void Features::var_order(int* vars) const
+{
+	// byte-local outputs come from a fold, its byte is the likely operand.
+	bool bytes = low_bytes_ > 0.8;
+	vars[0] = bytes ? 1 : 0;
+	vars[1] = bytes ? 2 : 1;
+	vars[2] = bytes ? 0 : 2;
+}
+
+void Features::print() const
+{
+	printf("features: shift %d%s match %.2f  dep left %d right %d (max %d) same %d none %d"
+		"  low bytes %.2f monotone %.2f carry %.2f density %.2f\n",
+		best_shift_, best_not_ ? " not" : "", shift_match_, dep_left_, dep_right_, max_right_,
+		dep_same_, dep_none_, low_bytes_, monotone_, carry_, density_);
+}
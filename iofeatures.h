@@ -0,0 +1,40 @@
+#ifndef IOFEATURES_H
+#define IOFEATURES_H
+
+#include "gen2.h"
+
+// Cheap signals computed over all I/O pairs at once, used to pick the order
+// in which Arena tries ops and vars. They only reorder the search, every op
+// is still tried.
+class Features
+{
+public:
+	Features();
+
+	void extract(const Val* in, const Val* out, int n);
+	// all ops of allowed plus the leaves, most promising first.
+	int order(OpSet allowed, Op* ops) const;
+	void var_order(int* vars) const;
+	void print() const;
+
+	// shift affinity: the shift (<0 is right) and polarity of the input
+	// that gets most output bits right, and the share it gets right.
+	int best_shift_;
+	bool best_not_;
+	double shift_match_;
+
+	// bit dependency: output bits that agree with one input bit on (almost)
+	// all pairs, by the direction that bit moved.
+	int dep_left_;
+	int dep_right_;
+	int dep_same_;
+	int dep_none_;
+	int max_right_; // farthest right move among them
+
+	double low_bytes_;  // byte locality: outputs below 2^16
+	double monotone_;   // outputs keep the order of the inputs
+	double carry_;      // out ^ in is a run of low ones, like x + 1
+	double density_;    // share of one bits in the varying output bits
+};
+
+#endif
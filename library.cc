@@ -0,0 +1,258 @@
+#include "library.h"
+#include "cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char library_magic[8] = { 'B', 'V', 'L', 'I', 'B', 0, 0, 0 };
+static const uint32_t library_version = 1;
+
+bool Library::open(const char* path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(Header)) {
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	data_ = (const char*)p;
+	length_ = st.st_size;
+
+	header_ = (const Header*)data_;
+	buckets_ = (const uint32_t*)(header_ + 1);
+	entries_ = (const Entry*)(buckets_ + header_->num_buckets + 1);
+	pool_ = (const char*)(entries_ + header_->num_entries);
+	size_t need = (pool_ - data_) + header_->pool_size;
+	if (memcmp(header_->magic, library_magic, sizeof(library_magic)) || header_->version != library_version ||
+			(header_->num_buckets & (header_->num_buckets - 1)) || need > length_) {
+		fprintf(stderr, "library: bad file %s\n", path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void Library::close()
+{
+	if (data_)
+		munmap((void*)data_, length_);
+	data_ = NULL;
+	length_ = 0;
+}
+
+int Library::ops_mask(OpSet ops, bool tfold)
+{
+	int mask = 0;
+	for (int op = FIRST_OP; op <= PLUS; op++)
+		if (ops.has((Op)op))
+			mask |= 1 << op;
+	if (tfold)
+		mask |= 1 << TFOLD;
+	return mask;
+}
+
+Val Library::key(Val fingerprint, int ops_mask)
+{
+	Val h = fingerprint ^ (ops_mask * 0x9e3779b97f4a7c15ul);
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ul;
+	h ^= h >> 29;
+	return h;
+}
+
+void Library::lookup(const Val* outputs, int ops_mask, std::vector<const char*>* programs) const
+{
+	if (!data_)
+		return;
+	Val k = key(SolutionCache::fingerprint(outputs), ops_mask);
+	uint32_t b = k & (header_->num_buckets - 1);
+	for (uint32_t i = buckets_[b]; i < buckets_[b + 1]; i++)
+		if (entries_[i].key == k)
+			programs->push_back(pool_ + entries_[i].program);
+}
+
+#ifdef LIBMAIN
+
+// Builds a library: library out.lib max_size ops... where every ops is a
+// comma separated op set such as not,shl1,and or tfold,plus, or @file to
+// take the op sets of the tasks of at most max_size listed by print.
+
+#include "parser.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+// keeps the first, thus smallest, program of every signature.
+class Builder : public Callback
+{
+public:
+	Builder(int mask, std::map<Val, std::pair<string, int> >* programs)
+		: mask_(mask), programs_(programs), count_(0)
+	{
+		SolutionCache::probe_inputs(&inputs_);
+	}
+
+	bool action(Expr* e, int size)
+	{
+		count_++;
+		Val outputs[64];
+		for (int i = 0; i < inputs_.size(); i++)
+			outputs[i] = e->run(inputs_[i]);
+		Val k = Library::key(SolutionCache::fingerprint(outputs), mask_);
+		if (programs_->find(k) == programs_->end())
+			(*programs_)[k] = std::make_pair(e->program(), size);
+		return true;
+	}
+
+	long count_;
+
+private:
+	int mask_;
+	std::map<Val, std::pair<string, int> >* programs_;
+	std::vector<Val> inputs_;
+};
+
+static bool parse_ops(const string& text, OpSet* ops, bool* tfold)
+{
+	*tfold = false;
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find_first_of(", ", start);
+		if (end == string::npos)
+			end = text.size();
+		string name = text.substr(start, end - start);
+		start = end + 1;
+		if (name.empty())
+			continue;
+		if (name == "tfold") {
+			*tfold = true;
+			continue;
+		}
+		Op op = Parser::op(name);
+		if (op == DUMMY_OP) {
+			fprintf(stderr, "unknown op %s\n", name.c_str());
+			return false;
+		}
+		ops->add(op);
+	}
+	return true;
+}
+
+// op sets of "  i: id size ... [ n]: op op ..." lines.
+static void read_tasks(const char* path, int max_size, std::vector<string>* sets)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return;
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		int size;
+		char* ops = strstr(line, "]:");
+		if (!ops || sscanf(line, "%*d: %*s %d", &size) != 1 || size > max_size)
+			continue;
+		string s = ops + 2;
+		s.erase(s.find_last_not_of(" \r\n") + 1);
+		sets->push_back(s);
+	}
+	fclose(f);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s out.lib max_size ops|@tasks...\n", argv[0]);
+		return 1;
+	}
+	int max_size = atoi(argv[2]);
+	std::vector<string> sets;
+	for (int i = 3; i < argc; i++) {
+		if (argv[i][0] == '@')
+			read_tasks(argv[i] + 1, max_size, &sets);
+		else
+			sets.push_back(argv[i]);
+	}
+
+	std::map<Val, std::pair<string, int> > programs;
+	std::set<int> done;
+	for (int i = 0; i < sets.size(); i++) {
+		OpSet ops;
+		bool tfold;
+		if (!parse_ops(sets[i], &ops, &tfold))
+			return 1;
+		int mask = Library::ops_mask(ops, tfold);
+		if (!done.insert(mask).second)
+			continue;
+		Builder builder(mask, &programs);
+		if (tfold) {
+			ArenaTfold a;
+			a.set_callback(&builder);
+			a.allowed_ops_ = ops;
+			a.generate(max_size);
+		} else {
+			Arena a;
+			a.set_callback(&builder);
+			a.allowed_ops_ = ops;
+			a.generate(max_size);
+		}
+		printf("%s: %ld programs, %d signatures in all\n", sets[i].c_str(), builder.count_, (int)programs.size());
+	}
+
+	// about two entries per bucket.
+	uint32_t num_buckets = 1;
+	while (num_buckets < programs.size() / 2)
+		num_buckets <<= 1;
+	std::vector<uint32_t> buckets(num_buckets + 1, 0);
+	for (std::map<Val, std::pair<string, int> >::iterator it = programs.begin(); it != programs.end(); ++it)
+		buckets[(it->first & (num_buckets - 1)) + 1]++;
+	for (uint32_t b = 0; b < num_buckets; b++)
+		buckets[b + 1] += buckets[b];
+
+	std::vector<Library::Entry> entries(programs.size());
+	std::vector<uint32_t> fill(buckets.begin(), buckets.end() - 1);
+	string pool;
+	for (std::map<Val, std::pair<string, int> >::iterator it = programs.begin(); it != programs.end(); ++it) {
+		Library::Entry& e = entries[fill[it->first & (num_buckets - 1)]++];
+		e.key = it->first;
+		e.program = pool.size();
+		e.size = it->second.second;
+		pool += it->second.first;
+		pool += '\0';
+	}
+
+	Library::Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, library_magic, sizeof(library_magic));
+	header.version = library_version;
+	header.max_size = max_size;
+	header.num_buckets = num_buckets;
+	header.num_entries = entries.size();
+	header.pool_size = pool.size();
+
+	FILE* f = fopen(argv[1], "wb");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(&buckets[0], sizeof(uint32_t), buckets.size(), f);
+	if (!entries.empty())
+		fwrite(&entries[0], sizeof(Library::Entry), entries.size(), f);
+	fwrite(pool.data(), 1, pool.size(), f);
+	fclose(f);
+	printf("%s: %d programs, %d buckets, %lu bytes of programs\n", argv[1],
+		(int)entries.size(), num_buckets, (unsigned long)pool.size());
+	return 0;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "gen2.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Every program up to some size, one per distinct output signature on the
+// cache probe inputs and op set, built offline (see LIBMAIN in library.cc)
+// into a file that is mmap'ed as is. The file is a header, a bucket array
+// of first entry indices (bucket i holds entries [b[i], b[i+1])), the
+// entries sorted by bucket and a pool of NUL-terminated programs, so a
+// small challenge is answered with a single bucket probe.
+class Library
+{
+public:
+	struct Header {
+		char     magic[8];
+		uint32_t version;
+		uint32_t max_size;
+		uint32_t num_buckets; // a power of two
+		uint32_t num_entries;
+		uint64_t pool_size;
+	};
+
+	struct Entry {
+		Val      key;
+		uint32_t program; // offset in the pool
+		uint32_t size;
+	};
+
+	Library() : data_(NULL), length_(0) {}
+	~Library() { close(); }
+
+	bool open(const char* path);
+	void close();
+	bool is_open() const { return data_ != NULL; }
+	int max_size() const { return header_->max_size; }
+	int count() const { return header_->num_entries; }
+
+	// the ops that tell libraries apart, tfold included.
+	static int ops_mask(OpSet ops, bool tfold);
+	static Val key(Val fingerprint, int ops_mask);
+
+	// programs with these outputs on the cache probe inputs.
+	void lookup(const Val* outputs, int ops_mask, std::vector<const char*>* programs) const;
+
+private:
+	const char* data_;
+	size_t length_;
+	const Header* header_;
+	const uint32_t* buckets_;
+	const Entry* entries_;
+	const char* pool_;
+};
+
+#endif
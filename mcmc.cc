@@ -0,0 +1,358 @@
+#include "mcmc.h"
+#include "analyzer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+McmcSearch::McmcSearch()
+{
+	verifier_ = NULL;
+	proposals_ = 0;
+	accepted_ = 0;
+	restarts_ = 0;
+	max_len_ = 0;
+	chains_ = 0;
+	time_limit_ = 120 * 1000;
+	started_ = 0;
+	beta_ = 0.05;
+	restart_after_ = 1000000;
+	generation_ = 0;
+	done_ = 0;
+	stop_ = 0;
+	pthread_mutex_init(&mutex_, NULL);
+}
+
+bool McmcSearch::generate(int size)
+{
+	static const Op leaves[] = { C0, C1, VAR };
+	static const Op inner[] = { NOT, SHL1, SHR1, SHR4, SHR16, AND, OR, XOR, PLUS, IF0 };
+	for (int a = 0; a < 4; a++)
+		ops_[a].clear();
+	for (int k = 0; k < sizeof(leaves) / sizeof(*leaves); k++)
+		ops_[0].push_back(leaves[k]);
+	for (int k = 0; k < sizeof(inner) / sizeof(*inner); k++)
+		if (allowed_ops_.has(inner[k]))
+			ops_[Expr::arity(inner[k])].push_back(inner[k]);
+
+	// the lambda takes one.
+	max_len_ = size - 1;
+	if (chains_ <= 0) {
+		chains_ = sysconf(_SC_NPROCESSORS_ONLN);
+		if (chains_ < 1)
+			chains_ = 1;
+		if (chains_ > 16)
+			chains_ = 16;
+	}
+	started_ = Verifier::now_ms();
+	done_ = 0;
+	stop_ = 0;
+
+	std::vector<Chain> chains(chains_);
+	std::vector<pthread_t> threads(chains_);
+	for (int i = 0; i < chains_; i++) {
+		Chain* c = &chains[i];
+		c->search = this;
+		c->rng = 0x9e3779b97f4a7c15ul * (i + 1) ^ started_;
+		// spread the temperatures, no single one suits every problem.
+		static const double spread[] = { 1, 0.5, 2 };
+		c->beta = beta_ * spread[i % 3];
+		c->generation = -1;
+		c->proposals = 0;
+		c->accepted = 0;
+		c->restarts = 0;
+		pthread_create(&threads[i], NULL, run, c);
+	}
+	for (int i = 0; i < chains_; i++) {
+		pthread_join(threads[i], NULL);
+		proposals_ += chains[i].proposals;
+		accepted_ += chains[i].accepted;
+		restarts_ += chains[i].restarts;
+	}
+	return stop_;
+}
+
+void* McmcSearch::run(void* arg)
+{
+	Chain* c = (Chain*)arg;
+	c->search->run_chain(c);
+	return NULL;
+}
+
+void McmcSearch::refresh(Chain* c)
+{
+	pthread_mutex_lock(&mutex_);
+	c->inputs.clear();
+	c->outputs.clear();
+	const Verifier::Pairs& pairs = verifier_->get_pairs();
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+		c->inputs.push_back(it->first);
+		c->outputs.push_back(it->second);
+	}
+	c->stack.resize((size_t)max_len_ * c->inputs.size());
+	c->scaled_beta = c->beta * 64 / c->inputs.size();
+	c->generation = generation_;
+	pthread_mutex_unlock(&mutex_);
+}
+
+void McmcSearch::run_chain(Chain* c)
+{
+	Program cur, next_prog;
+	int cur_cost = 0;
+	int best_cost = 0;
+	long since_best = 0;
+	bool restart = true;
+
+	while (!done_) {
+		if (c->generation != generation_) {
+			refresh(c);
+			if (!restart)
+				best_cost = cur_cost = cost(c, cur);
+		}
+		if (restart) {
+			cur.clear();
+			random_tree(c, 1 + pick(c, max_len_), &cur);
+			best_cost = cur_cost = cost(c, cur);
+			since_best = 0;
+			restart = false;
+		}
+
+		if (cur_cost == 0) {
+			if (!found(c, cur))
+				break;
+			// nothing learnt from the candidate, start over.
+			if (c->generation == generation_) {
+				c->restarts++;
+				restart = true;
+			}
+			continue;
+		}
+
+		if (!mutate(c, cur, &next_prog))
+			continue;
+		c->proposals++;
+		int next_cost = cost(c, next_prog);
+		int delta = next_cost - cur_cost;
+		double u = (next(c) >> 11) * (1.0 / 9007199254740992.0);
+		if (delta <= 0 || u < exp(-c->scaled_beta * delta)) {
+			cur.swap(next_prog);
+			cur_cost = next_cost;
+			c->accepted++;
+		}
+
+		if (cur_cost < best_cost) {
+			best_cost = cur_cost;
+			since_best = 0;
+		} else if (++since_best > restart_after_) {
+			c->restarts++;
+			restart = true;
+		}
+
+		if ((c->proposals & 0xfff) == 0 && (Verifier::now_ms() - started_ > time_limit_ || !poll()))
+			break;
+	}
+	__sync_lock_test_and_set(&done_, 1);
+}
+
+bool McmcSearch::poll()
+{
+	pthread_mutex_lock(&mutex_);
+	// the verifier's deadline, shared with the other stages. It may also
+	// resolve candidates it held, and learn pairs from them.
+	size_t seen = verifier_->get_pairs().size();
+	bool go_on = done_ || verifier_->poll();
+	if (verifier_->get_pairs().size() != seen)
+		__sync_fetch_and_add(&generation_, 1);
+	pthread_mutex_unlock(&mutex_);
+	return go_on;
+}
+
+bool McmcSearch::found(Chain* c, const Program& p)
+{
+	bool go_on = true;
+	pthread_mutex_lock(&mutex_);
+	// another chain may have got here first with a different pair set.
+	if (!done_ && c->generation == generation_) {
+		int pos = 0;
+		Expr* e = build(p, &pos);
+		size_t seen = verifier_->get_pairs().size();
+		go_on = verifier_->action(e, p.size() + 1);
+		pool_.clear();
+		if (!go_on)
+			stop_ = 1;
+		else if (verifier_->get_pairs().size() != seen)
+			__sync_fetch_and_add(&generation_, 1);
+	}
+	pthread_mutex_unlock(&mutex_);
+	return go_on;
+}
+
+Expr* McmcSearch::build(const Program& p, int* pos)
+{
+	Op op = p[(*pos)++];
+	if (op == VAR)
+		return pool_.var(0);
+	Expr* opnd[3] = { NULL, NULL, NULL };
+	int arity = Expr::arity(op);
+	for (int i = 0; i < arity; i++)
+		opnd[i] = build(p, pos);
+	return pool_.make(op, opnd[0], opnd[1], opnd[2]);
+}
+
+// end of the subtree starting at i.
+int McmcSearch::end(const Program& p, int i)
+{
+	int need = 1;
+	while (need) {
+		need += Expr::arity(p[i]) - 1;
+		i++;
+	}
+	return i;
+}
+
+Val McmcSearch::next(Chain* c)
+{
+	c->rng ^= c->rng << 13;
+	c->rng ^= c->rng >> 7;
+	c->rng ^= c->rng << 17;
+	return c->rng;
+}
+
+// Hamming distance to the outputs summed over all pairs. The program is
+// run backwards, so the first operand of an op is on top of the stack.
+int McmcSearch::cost(Chain* c, const Program& p)
+{
+	int n = c->inputs.size();
+	Val* stack = &c->stack[0];
+	int sp = 0;
+	for (int i = p.size() - 1; i >= 0; i--) {
+		Op op = p[i];
+		if (Expr::arity(op) == 0) {
+			Val* r = stack + (size_t)sp++ * n;
+			for (int j = 0; j < n; j++)
+				r[j] = op == VAR ? c->inputs[j] : op == C1;
+			continue;
+		}
+		Val* a = stack + (size_t)(sp - 1) * n;
+		Val* b = a - n;
+		Val* r = a;
+		switch (op) {
+		case NOT:   for (int j = 0; j < n; j++) r[j] = ~a[j]; break;
+		case SHL1:  for (int j = 0; j < n; j++) r[j] = a[j] << 1; break;
+		case SHR1:  for (int j = 0; j < n; j++) r[j] = a[j] >> 1; break;
+		case SHR4:  for (int j = 0; j < n; j++) r[j] = a[j] >> 4; break;
+		case SHR16: for (int j = 0; j < n; j++) r[j] = a[j] >> 16; break;
+
+		case AND:   for (int j = 0; j < n; j++) b[j] &= a[j]; sp--; break;
+		case OR:    for (int j = 0; j < n; j++) b[j] |= a[j]; sp--; break;
+		case XOR:   for (int j = 0; j < n; j++) b[j] ^= a[j]; sp--; break;
+		case PLUS:  for (int j = 0; j < n; j++) b[j] += a[j]; sp--; break;
+
+		case IF0: {
+			Val* e = b - n;
+			for (int j = 0; j < n; j++)
+				e[j] = a[j] == 0 ? b[j] : e[j];
+			sp -= 2;
+			break;
+		}
+		default:
+			fprintf(stderr, "mcmc: bad op %d\n", op);
+			exit(1);
+		}
+	}
+
+	Analyzer an;
+	int d = 0;
+	for (int j = 0; j < n; j++)
+		d += an.base_distance(stack[j], c->outputs[j]);
+	return d;
+}
+
+// appends a random tree of at most size nodes.
+void McmcSearch::random_tree(Chain* c, int size, Program* out)
+{
+	int choices = ops_[0].size();
+	for (int a = 1; a < 4 && a < size; a++)
+		choices += ops_[a].size();
+	int k = pick(c, choices);
+	int arity = 0;
+	while (k >= (int)ops_[arity].size())
+		k -= ops_[arity++].size();
+	out->push_back(ops_[arity][k]);
+
+	// share the rest among the operands, at least one each.
+	int left = size - 1;
+	for (int i = 0; i < arity; i++) {
+		int later = arity - 1 - i;
+		int s = later ? 1 + pick(c, left - later) : left;
+		random_tree(c, s, out);
+		left -= s;
+	}
+}
+
+bool McmcSearch::mutate(Chain* c, const Program& from, Program* to)
+{
+	int len = from.size();
+	int i = pick(c, len);
+	int e = end(from, i);
+	Op op = from[i];
+	int arity = Expr::arity(op);
+
+	to->assign(from.begin(), from.begin() + i);
+	switch (pick(c, 4)) {
+	case 0: {
+		// replace the subtree
+		int room = max_len_ - (len - (e - i));
+		random_tree(c, 1 + pick(c, room), to);
+		break;
+	}
+	case 1: {
+		// swap the op for another of the same arity
+		const std::vector<Op>& same = ops_[arity];
+		if (same.size() < 2)
+			return false;
+		Op other = same[pick(c, same.size())];
+		if (other == op)
+			return false;
+		to->push_back(other);
+		to->insert(to->end(), from.begin() + i + 1, from.begin() + e);
+		break;
+	}
+	case 2: {
+		// insert a node above the subtree, it becomes one of the operands
+		int room = max_len_ - len - 1;
+		if (room < 0)
+			return false;
+		int wrap = 1 + pick(c, 3);
+		if (ops_[wrap].empty() || room < wrap - 1)
+			return false;
+		to->push_back(ops_[wrap][pick(c, ops_[wrap].size())]);
+		int keep = pick(c, wrap);
+		for (int k = 0; k < wrap; k++) {
+			if (k == keep) {
+				to->insert(to->end(), from.begin() + i, from.begin() + e);
+				continue;
+			}
+			int later = wrap - 1 - k - (k < keep);
+			int s = 1 + pick(c, room - later);
+			int before = to->size();
+			random_tree(c, s, to);
+			room -= to->size() - before;
+		}
+		break;
+	}
+	default: {
+		// remove the node, one of its operands takes its place
+		if (!arity)
+			return false;
+		int k = pick(c, arity);
+		int j = i + 1;
+		while (k--)
+			j = end(from, j);
+		to->insert(to->end(), from.begin() + j, from.begin() + end(from, j));
+		break;
+	}
+	}
+	to->insert(to->end(), from.begin() + e, from.end());
+	return true;
+}
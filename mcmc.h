@@ -0,0 +1,84 @@
+#ifndef MCMC_H
+#define MCMC_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <pthread.h>
+#include <vector>
+
+// Stochastic search for programs too large to enumerate. A chain keeps one
+// program and proposes random edits to it (replace a subtree, swap an op,
+// insert or remove a node) within the size and op constraints. Edits are
+// accepted by the Metropolis-Hastings rule on the number of wrong output
+// bits over all pairs. Programs are kept as preorder token strings, only
+// fold-free ones are searched. Several independent chains run in threads,
+// each at its own temperature.
+class McmcSearch
+{
+public:
+	McmcSearch();
+
+	void set_callback(Verifier* v) { verifier_ = v; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+	void set_chains(int n) { chains_ = n; }
+	void set_time_limit(long ms) { time_limit_ = ms; }
+	void set_beta(double beta) { beta_ = beta; }
+
+	// true if the callback asked to stop.
+	bool generate(int size);
+
+	OpSet allowed_ops_;
+	long proposals_;
+	long accepted_;
+	long restarts_;
+
+private:
+	typedef std::vector<Op> Program; // preorder, VAR is x0
+
+	struct Chain {
+		McmcSearch* search;
+		Val rng;
+		double beta;           // per 64 pairs, scaled in refresh
+		double scaled_beta;
+		int generation;        // of the pairs below
+		std::vector<Val> inputs;
+		std::vector<Val> outputs;
+		std::vector<Val> stack; // eval rows, one per pending operand
+		long proposals;
+		long accepted;
+		long restarts;
+	};
+
+	static void* run(void* arg);
+	void run_chain(Chain* c);
+	void refresh(Chain* c);
+	bool found(Chain* c, const Program& p);
+	bool poll();
+
+	int cost(Chain* c, const Program& p);
+	bool mutate(Chain* c, const Program& from, Program* to);
+	void random_tree(Chain* c, int size, Program* out);
+	Expr* build(const Program& p, int* pos);
+
+	static int end(const Program& p, int i);
+	static Val next(Chain* c);
+	int pick(Chain* c, int n) { return next(c) % n; }
+
+	Verifier* verifier_;
+	ExprPool pool_;
+	pthread_mutex_t mutex_; // around the verifier and the pairs
+	std::vector<Op> ops_[4]; // allowed ops by arity
+	int max_len_;
+	int chains_;
+	long time_limit_;
+	long started_;
+	double beta_;
+	long restart_after_;
+
+	volatile int generation_;
+	volatile int done_;
+	volatile int stop_; // callback asked to stop
+};
+
+#endif
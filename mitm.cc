@@ -0,0 +1,81 @@
+#include "mitm.h"
+
+Expr* MitmSolver::solve(const Val* out, int size, ExprPool* pool)
+{
+	need_.resize(bank_->inputs());
+	best_size_ = size + 1;
+
+	if (allowed_ops_.has(XOR))
+		lookup(XOR, out);
+	if (allowed_ops_.has(PLUS))
+		lookup(PLUS, out);
+	if (allowed_ops_.has(AND))
+		join(AND, out);
+	if (allowed_ops_.has(OR))
+		join(OR, out);
+
+	if (best_size_ > size)
+		return NULL;
+	return pool->make(best_op_, bank_->build(best_a_, pool), bank_->build(best_b_, pool));
+}
+
+void MitmSolver::found(Op op, int a, int b)
+{
+	int size = bank_->term(a).size + bank_->term(b).size + 1;
+	if (size < best_size_) {
+		best_size_ = size;
+		best_op_ = op;
+		best_a_ = a;
+		best_b_ = b;
+	}
+}
+
+void MitmSolver::lookup(Op op, const Val* out)
+{
+	int n = bank_->inputs();
+	for (int a = 0; a < bank_->count(); a++) {
+		if (bank_->term(a).size + 2 >= best_size_)
+			break; // terms are ordered by size
+		const Val* va = bank_->values(a);
+		for (int i = 0; i < n; i++)
+			need_[i] = op == XOR ? out[i] ^ va[i] : out[i] - va[i];
+		lookups_++;
+		int b = bank_->find(&need_[0]);
+		if (b >= 0)
+			found(op, a, b);
+	}
+}
+
+void MitmSolver::join(Op op, const Val* out)
+{
+	int n = bank_->inputs();
+
+	// and needs both operands to cover the outputs, or to be covered by them.
+	std::vector<int> fit;
+	for (int t = 0; t < bank_->count(); t++) {
+		const Val* v = bank_->values(t);
+		bool ok = true;
+		for (int i = 0; i < n && ok; i++)
+			ok = op == AND ? !(out[i] & ~v[i]) : !(v[i] & ~out[i]);
+		if (ok)
+			fit.push_back(t);
+	}
+
+	for (int i = 0; i < (int)fit.size(); i++) {
+		int a = fit[i];
+		const Val* va = bank_->values(a);
+		for (int j = i; j < (int)fit.size(); j++) {
+			int b = fit[j];
+			if (bank_->term(a).size + bank_->term(b).size + 1 >= best_size_)
+				break;
+			if (++joins_ > max_joins_)
+				return;
+			const Val* vb = bank_->values(b);
+			bool ok = true;
+			for (int k = 0; k < n && ok; k++)
+				ok = (op == AND ? va[k] & vb[k] : va[k] | vb[k]) == out[k];
+			if (ok)
+				found(op, a, b);
+		}
+	}
+}
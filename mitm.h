@@ -0,0 +1,40 @@
+#ifndef MITM_H
+#define MITM_H
+
+#include "gen2.h"
+#include "bank.h"
+
+// Meet in the middle for programs of the shape (op A B) with op among xor,
+// plus, and, or. For xor and plus B is looked up in the bank index from A
+// and the outputs (B = out ^ A, B = out - A). For and/or only terms that
+// are a superset/subset of the outputs can take part, and those are joined
+// pairwise.
+class MitmSolver
+{
+public:
+	MitmSolver(const Bank* bank) : max_joins_(50000000), lookups_(0), joins_(0), bank_(bank) {}
+
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+
+	// smallest (op A B) of at most size reproducing out, NULL if none.
+	Expr* solve(const Val* out, int size, ExprPool* pool);
+
+	OpSet allowed_ops_;
+	long max_joins_;
+	long lookups_;
+	long joins_;
+
+private:
+	void lookup(Op op, const Val* out);
+	void join(Op op, const Val* out);
+	void found(Op op, int a, int b);
+
+	const Bank* bank_;
+	std::vector<Val> need_;
+	Op best_op_;
+	int best_a_;
+	int best_b_;
+	int best_size_;
+};
+
+#endif
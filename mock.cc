@@ -0,0 +1,659 @@
+#define __STDC_FORMAT_MACROS
+
+#include "gen2.h"
+#include "bank.h"
+#include "parser.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <jsoncpp/json/json.h>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using std::string;
+
+// A stand-in for the contest server, to run the solver against known
+// secrets: serves train, eval, guess and myproblems with the same JSON
+// shapes and status codes, evaluates the secrets with Expr::run and checks
+// guesses on a few thousand inputs. Latency, rate limiting and failures can
+// be dialed in, see usage().
+//
+// The secrets file has one problem per line,
+//     id size ops program
+// with ops comma separated as in the problem list, e.g.
+//     p1 8 fold,shr4,xor (lambda (x0) (fold x0 0 (lambda (y z) (xor y z))))
+// A line with just a program gets a running id and its size and ops taken
+// from the program. sampler.cc built with -DSAMPLEMAIN writes such files.
+//
+// The client side is pointed at it with e.g. API=http://localhost:8013.
+// It is built like bench.cc, with
+//     g++ -O2 -pthread -o mock mock.cc $SOLVER -ljsoncpp
+
+static long now_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000l + tv.tv_usec / 1000;
+}
+
+struct Secret
+{
+    string id;
+    int size;
+    string operators; // comma separated
+    string program;
+    Expr* expr;
+    bool train;
+    bool solved;
+    long started; // 0 until the first eval or guess
+};
+
+struct Options
+{
+    Options() : port(8013), latency_ms(0), jitter_ms(0), rate(0), window_s(20),
+        error_rate(0), time_limit_s(300), seed(1) {}
+
+    int port;
+    int latency_ms;
+    int jitter_ms;
+    int rate;     // requests per window, 0 for no limit
+    int window_s;
+    double error_rate; // share of requests failing with 500 or a cut body
+    int time_limit_s;
+    unsigned seed;
+};
+
+class MockServer
+{
+public:
+    MockServer(const Options& options);
+
+    bool load(const char* path);
+    bool run();
+
+private:
+    // status code and body for one request.
+    int handle(const string& command, const string& body, string* out);
+    int eval(const Json::Value& request, string* out);
+    int guess(const Json::Value& request, string* out);
+    int train(const Json::Value& request, string* out);
+    int myproblems(string* out);
+
+    // 0 if the problem may be asked about, the error status otherwise.
+    int open(Secret* s, string* out);
+    bool rate_limited();
+    Val random();
+
+    void serve(int fd);
+
+    Options options_;
+    ExprPool pool_;
+    Parser parser_;
+    std::vector<Secret*> secrets_;
+    std::map<string, Secret*> by_id_;
+    std::deque<long> recent_; // request times within the window
+    std::vector<Val> check_inputs_;
+    Val rng_;
+    int trains_;
+};
+
+static const char* op_name(Op op)
+{
+    switch (op) {
+    case IF0:   return "if0";
+    case FOLD:  return "fold";
+    case NOT:   return "not";
+    case SHL1:  return "shl1";
+    case SHR1:  return "shr1";
+    case SHR4:  return "shr4";
+    case SHR16: return "shr16";
+    case AND:   return "and";
+    case OR:    return "or";
+    case XOR:   return "xor";
+    case PLUS:  return "plus";
+    default:    return NULL;
+    }
+}
+
+static void collect_ops(Expr* e, bool* seen)
+{
+    seen[e->op] = true;
+    for (int i = 0; i < e->arity(); i++)
+        collect_ops(e->opnd[i], seen);
+}
+
+// the ops listed for a program, with a fold over the whole input as tfold.
+static string operators_of(Expr* e)
+{
+    bool seen[MAX_OP] = { false };
+    collect_ops(e, seen);
+    bool tfold = e->op == FOLD && e->opnd[0]->is_var(0) && e->opnd[1]->op == C0;
+    string ops;
+    if (tfold) {
+        ops = "tfold";
+        seen[FOLD] = false;
+    }
+    for (int op = FIRST_OP; op < MAX_OP; op++) {
+        const char* name = op_name((Op)op);
+        if (!seen[op] || !name)
+            continue;
+        if (!ops.empty())
+            ops += ",";
+        ops += name;
+    }
+    return ops;
+}
+
+static void put_hex(Val v, string* out)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "\"0x%016" PRIX64 "\"", v);
+    *out += buffer;
+}
+
+static bool get_hex(const Json::Value& value, Val* v)
+{
+    if (!value.isString())
+        return false;
+    const char* s = value.asCString();
+    char* end;
+    *v = strtoull(s, &end, 16);
+    return end != s && !*end;
+}
+
+static string quoted(const string& s)
+{
+    string out = "\"";
+    for (int i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\')
+            out += '\\';
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+static string operators_json(const string& ops)
+{
+    string out = "[";
+    std::stringstream stream(ops);
+    string op;
+    while (std::getline(stream, op, ','))
+        out += (out.size() > 1 ? "," : "") + quoted(op);
+    return out + "]";
+}
+
+MockServer::MockServer(const Options& options)
+    : options_(options), trains_(0)
+{
+    rng_ = 0x9e3779b97f4a7c15ul ^ options.seed;
+
+    static const Val patterns[] = {
+        0x0, 0xffffffffffffffff, 0x5555555555555555, 0xaaaaaaaaaaaaaaaa,
+        0x8000000000000000, 0x1, 0x00000000ffffffff, 0xffffffff00000000
+    };
+    for (int i = 0; i < sizeof(patterns) / sizeof(*patterns); i++)
+        check_inputs_.push_back(patterns[i]);
+    for (int i = 0; i < 64; i++)
+        check_inputs_.push_back(1ul << i);
+    while (check_inputs_.size() < 4096) {
+        Val v = random();
+        // sparse and single byte ones too, folds mostly look at low bytes.
+        switch (check_inputs_.size() % 4) {
+        case 1: v &= random(); break;
+        case 2: v &= 0xff; break;
+        }
+        check_inputs_.push_back(v);
+    }
+}
+
+Val MockServer::random()
+{
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    return rng_;
+}
+
+bool MockServer::load(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "can't read %s\n", path);
+        return false;
+    }
+
+    char line[4096];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        string text = line;
+        while (!text.empty() && (text[text.size() - 1] == '\n' || text[text.size() - 1] == '\r'))
+            text.erase(text.size() - 1);
+        if (text.empty() || text[0] == '#')
+            continue;
+
+        Secret* s = new Secret;
+        size_t program_at = text.find('(');
+        if (program_at == string::npos) {
+            fprintf(stderr, "%s:%d: no program\n", path, lineno);
+            delete s;
+            continue;
+        }
+        s->program = text.substr(program_at);
+        s->expr = parser_.parse(s->program, &pool_);
+        if (!s->expr) {
+            fprintf(stderr, "%s:%d: %s\n", path, lineno, parser_.error_.c_str());
+            delete s;
+            continue;
+        }
+
+        std::stringstream head(text.substr(0, program_at));
+        if (!(head >> s->id >> s->size >> s->operators)) {
+            char id[32];
+            snprintf(id, sizeof(id), "p%d", lineno);
+            s->id = id;
+            s->size = ExprPool::size(s->expr) + 1;
+            s->operators = operators_of(s->expr);
+        }
+        s->train = false;
+        s->solved = false;
+        s->started = 0;
+        if (by_id_.count(s->id)) {
+            fprintf(stderr, "%s:%d: duplicate id %s\n", path, lineno, s->id.c_str());
+            delete s;
+            continue;
+        }
+        secrets_.push_back(s);
+        by_id_[s->id] = s;
+    }
+    fclose(f);
+    printf("mock: %d problems from %s\n", (int)secrets_.size(), path);
+    return true;
+}
+
+bool MockServer::rate_limited()
+{
+    if (!options_.rate)
+        return false;
+    long now = now_ms();
+    while (!recent_.empty() && recent_.front() <= now - options_.window_s * 1000l)
+        recent_.pop_front();
+    if ((int)recent_.size() >= options_.rate)
+        return true;
+    recent_.push_back(now);
+    return false;
+}
+
+int MockServer::open(Secret* s, string* out)
+{
+    if (s->solved) {
+        *out = "already solved";
+        return 412;
+    }
+    long now = now_ms();
+    if (!s->started)
+        s->started = now;
+    else if (now - s->started > options_.time_limit_s * 1000l) {
+        *out = "time limit exceeded";
+        return 410;
+    }
+    return 0;
+}
+
+int MockServer::eval(const Json::Value& request, string* out)
+{
+    const Json::Value& arguments = request["arguments"];
+    if (!arguments.isArray()) {
+        *out = "no arguments";
+        return 400;
+    }
+    if (arguments.size() > 256) {
+        *out = "too many arguments";
+        return 413;
+    }
+
+    ExprPool pool;
+    Expr* e;
+    if (request.isMember("program")) {
+        e = parser_.parse(request["program"].asString(), &pool);
+        if (!e) {
+            *out = "{\"status\":\"error\",\"message\":" + quoted(parser_.error_) + "}";
+            return 200;
+        }
+    } else {
+        std::map<string, Secret*>::iterator it = by_id_.find(request["id"].asString());
+        if (it == by_id_.end()) {
+            *out = "no such problem";
+            return 404;
+        }
+        int status = open(it->second, out);
+        if (status)
+            return status;
+        e = it->second->expr;
+    }
+
+    *out = "{\"status\":\"ok\",\"outputs\":[";
+    for (int i = 0; i < arguments.size(); i++) {
+        Val v;
+        if (!get_hex(arguments[i], &v)) {
+            *out = "bad argument";
+            return 400;
+        }
+        if (i)
+            *out += ",";
+        put_hex(e->run(v), out);
+    }
+    *out += "]}";
+    return 200;
+}
+
+int MockServer::guess(const Json::Value& request, string* out)
+{
+    std::map<string, Secret*>::iterator it = by_id_.find(request["id"].asString());
+    if (it == by_id_.end()) {
+        *out = "no such problem";
+        return 404;
+    }
+    Secret* s = it->second;
+    int status = open(s, out);
+    if (status)
+        return status;
+
+    ExprPool pool;
+    Expr* e = parser_.parse(request["program"].asString(), &pool);
+    if (!e) {
+        *out = "{\"status\":\"error\",\"message\":" + quoted(parser_.error_) + "}";
+        return 200;
+    }
+
+    for (int i = 0; i < check_inputs_.size(); i++) {
+        Val in = check_inputs_[i];
+        Val expected = s->expr->run(in);
+        Val got = e->run(in);
+        if (expected != got) {
+            *out = "{\"status\":\"mismatch\",\"values\":[";
+            put_hex(in, out);
+            *out += ",";
+            put_hex(expected, out);
+            *out += ",";
+            put_hex(got, out);
+            *out += "]}";
+            return 200;
+        }
+    }
+    s->solved = true;
+    *out = "{\"status\":\"win\"}";
+    return 200;
+}
+
+int MockServer::train(const Json::Value& request, string* out)
+{
+    int size = request.get("size", 0).asInt();
+    // "tfold" and "fold" ask for those, "" for neither, none for any.
+    bool any = !request.isMember("operators");
+    string want = request.get("operators", "").asString();
+
+    std::vector<Secret*> matches;
+    for (int i = 0; i < secrets_.size(); i++) {
+        Secret* s = secrets_[i];
+        if (s->train || (size && s->size != size))
+            continue;
+        bool tfold = s->operators.compare(0, 5, "tfold") == 0;
+        bool fold = !tfold && ("," + s->operators + ",").find(",fold,") != string::npos;
+        if (any || (want == "tfold" && tfold) || (want == "fold" && fold) ||
+                (want.empty() && !tfold && !fold))
+            matches.push_back(s);
+    }
+    if (matches.empty()) {
+        *out = "no such training problem";
+        return 404;
+    }
+
+    Secret* s = new Secret(*matches[random() % matches.size()]);
+    char id[32];
+    snprintf(id, sizeof(id), "train%d", ++trains_);
+    s->id = id;
+    s->train = true;
+    s->solved = false;
+    s->started = 0;
+    secrets_.push_back(s);
+    by_id_[s->id] = s;
+
+    *out = "{\"challenge\":" + quoted(s->program) + ",\"id\":" + quoted(s->id);
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), ",\"size\":%d", s->size);
+    *out += buffer;
+    *out += ",\"operators\":" + operators_json(s->operators) + "}";
+    return 200;
+}
+
+int MockServer::myproblems(string* out)
+{
+    *out = "[";
+    long now = now_ms();
+    bool first = true;
+    for (int i = 0; i < secrets_.size(); i++) {
+        Secret* s = secrets_[i];
+        if (s->train)
+            continue;
+        char buffer[64];
+        *out += first ? "{" : ",{";
+        first = false;
+        *out += "\"id\":" + quoted(s->id);
+        snprintf(buffer, sizeof(buffer), ",\"size\":%d", s->size);
+        *out += buffer;
+        *out += ",\"operators\":" + operators_json(s->operators);
+        if (s->solved)
+            *out += ",\"solved\":true";
+        if (s->started) {
+            long left = options_.time_limit_s - (now - s->started) / 1000;
+            snprintf(buffer, sizeof(buffer), ",\"timeLeft\":%ld", left > 0 ? left : 0);
+            *out += buffer;
+        }
+        *out += "}";
+    }
+    *out += "]";
+    return 200;
+}
+
+int MockServer::handle(const string& command, const string& body, string* out)
+{
+    if (rate_limited()) {
+        *out = "try again later";
+        return 429;
+    }
+    if (command == "myproblems")
+        return myproblems(out);
+
+    Json::Value request;
+    Json::Reader reader;
+    if (!reader.parse(body, request) || !request.isObject()) {
+        *out = "malformed request";
+        return 400;
+    }
+    if (command == "eval")
+        return eval(request, out);
+    if (command == "guess")
+        return guess(request, out);
+    if (command == "train")
+        return train(request, out);
+    *out = "not found";
+    return 404;
+}
+
+static const char* reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 410: return "Gone";
+    case 412: return "Precondition Failed";
+    case 413: return "Request Too Large";
+    case 429: return "Too Many Requests";
+    default:  return "Internal Server Error";
+    }
+}
+
+static bool write_all(int fd, const char* data, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0)
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// one request per connection, as curl is fine with that.
+void MockServer::serve(int fd)
+{
+    string request;
+    char buffer[65536];
+    size_t header_end = string::npos;
+    size_t length = 0;
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            return;
+        request.append(buffer, n);
+        if (header_end == string::npos) {
+            header_end = request.find("\r\n\r\n");
+            if (header_end == string::npos)
+                continue;
+            header_end += 4;
+            // header names are case insensitive.
+            string head = request.substr(0, header_end);
+            for (int i = 0; i < head.size(); i++)
+                head[i] = tolower(head[i]);
+            size_t at = head.find("\r\ncontent-length:");
+            if (at != string::npos)
+                length = strtoul(head.c_str() + at + 17, NULL, 10);
+            // curl waits for this before sending a larger body.
+            if (head.find("\r\nexpect: 100-continue") != string::npos)
+                write_all(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+        }
+        if (request.size() >= header_end + length)
+            break;
+    }
+
+    // "POST /eval?auth=... HTTP/1.1"
+    size_t path = request.find(' ');
+    size_t path_end = request.find_first_of("? ", path + 1);
+    string command = request.substr(path + 2, path_end - path - 2);
+    string body = request.substr(header_end, length);
+
+    string out;
+    int status = handle(command, body, &out);
+
+    if (options_.latency_ms || options_.jitter_ms)
+        usleep((options_.latency_ms + (options_.jitter_ms ? random() % options_.jitter_ms : 0)) * 1000);
+
+    // injected failures hit after the work, like a lost response would.
+    bool cut = false;
+    if (options_.error_rate > 0 && (random() % 1000000) < options_.error_rate * 1000000) {
+        if (random() % 2) {
+            status = 500;
+            out = "injected failure";
+        } else
+            cut = true;
+    }
+
+    printf("mock: %s %d %s\n", command.c_str(), status, body.c_str());
+
+    char head[256];
+    snprintf(head, sizeof(head),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+        status, reason(status), (int)out.size());
+    write_all(fd, head, strlen(head));
+    write_all(fd, out.data(), cut ? out.size() / 2 : out.size());
+}
+
+bool MockServer::run()
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return false;
+    }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(options_.port);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, 16) < 0) {
+        perror("bind");
+        close(sock);
+        return false;
+    }
+    printf("mock: listening on http://localhost:%d\n", options_.port);
+    fflush(stdout);
+
+    while (true) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0)
+            continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        serve(fd);
+        close(fd);
+        fflush(stdout);
+    }
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: mock [options] secrets.txt\n"
+        "  -p port       to listen on, 8013\n"
+        "  -l ms         latency added to every response\n"
+        "  -j ms         random extra latency, up to this\n"
+        "  -r n          requests allowed per window, then 429\n"
+        "  -w seconds    rate limit window, 20\n"
+        "  -e rate       share of responses failing, half with 500, half cut short\n"
+        "  -t seconds    time limit per problem, 300\n"
+        "  -s seed       for train picks, latency and failures\n");
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    int c;
+    while ((c = getopt(argc, argv, "p:l:j:r:w:e:t:s:")) != -1) {
+        switch (c) {
+        case 'p': options.port = atoi(optarg); break;
+        case 'l': options.latency_ms = atoi(optarg); break;
+        case 'j': options.jitter_ms = atoi(optarg); break;
+        case 'r': options.rate = atoi(optarg); break;
+        case 'w': options.window_s = atoi(optarg); break;
+        case 'e': options.error_rate = atof(optarg); break;
+        case 't': options.time_limit_s = atoi(optarg); break;
+        case 's': options.seed = atoi(optarg); break;
+        default: usage(); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    MockServer server(options);
+    if (!server.load(argv[optind]))
+        return 1;
+    return server.run() ? 0 : 1;
+}
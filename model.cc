@@ -0,0 +1,126 @@
+#include "model.h"
+#include "bank.h"
+
+#include <algorithm>
+
+// contexts seen less often keep the default order.
+static const int min_samples = 8;
+
+OrderModel::OrderModel()
+{
+	samples_ = 0;
+	memset(counts_, 0, sizeof(counts_));
+	update();
+}
+
+int OrderModel::bucket(int left_ops)
+{
+	if (left_ops <= 1)
+		return 0;
+	if (left_ops == 2)
+		return 1;
+	if (left_ops <= 4)
+		return 2;
+	if (left_ops <= 8)
+		return 3;
+	return 4;
+}
+
+// the order Arena emits e in: operands from the last one, then the op. A
+// fold's lambda is a sequence of its own and takes its size here.
+void OrderModel::flatten(Expr* e, std::vector<Op>* ops, std::vector<int>* widths)
+{
+	int arity = e->op == FOLD ? 2 : e->arity();
+	for (int i = arity - 1; i >= 0; i--)
+		flatten(e->opnd[i], ops, widths);
+	ops->push_back(e->op);
+	if (e->op == FOLD) {
+		widths->push_back(ExprPool::size(e->opnd[2]) + 2);
+		std::vector<Op> body_ops;
+		std::vector<int> body_widths;
+		flatten(e->opnd[2], &body_ops, &body_widths);
+		learn_sequence(body_ops, body_widths);
+	} else {
+		widths->push_back(1);
+	}
+}
+
+void OrderModel::learn_sequence(const std::vector<Op>& ops, const std::vector<int>& widths)
+{
+	int left = 0;
+	for (int i = 0; i < widths.size(); i++)
+		left += widths[i];
+	Op prev = DUMMY_OP;
+	for (int i = 0; i < ops.size(); i++) {
+		counts_[prev][bucket(left)][ops[i]]++;
+		samples_++;
+		left -= widths[i];
+		prev = ops[i];
+	}
+}
+
+void OrderModel::learn(Expr* program)
+{
+	std::vector<Op> ops;
+	std::vector<int> widths;
+	flatten(program, &ops, &widths);
+	learn_sequence(ops, widths);
+	update();
+}
+
+void OrderModel::update()
+{
+	for (int prev = 0; prev < MAX_OP; prev++) {
+		for (int b = 0; b < NUM_BUCKETS; b++) {
+			const int* counts = counts_[prev][b];
+			Op* order = orders_[prev][b];
+			int total = 0;
+			for (int i = 0; i < NUM_OPS; i++) {
+				order[i] = (Op)(FIRST_OP + i);
+				total += counts[order[i]];
+			}
+			known_[prev][b] = total >= min_samples;
+			// stable, so unseen ops keep their enum order.
+			for (int i = 1; i < NUM_OPS; i++)
+				for (int j = i; j > 0 && counts[order[j]] > counts[order[j - 1]]; j--)
+					std::swap(order[j], order[j - 1]);
+		}
+	}
+}
+
+const Op* OrderModel::order(Op prev, int left_ops) const
+{
+	int b = bucket(left_ops);
+	return known_[prev][b] ? orders_[prev][b] : NULL;
+}
+
+bool OrderModel::load(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return false;
+	int prev, b, op, count;
+	while (fscanf(f, "%d %d %d %d", &prev, &b, &op, &count) == 4) {
+		if (prev < 0 || prev >= MAX_OP || b < 0 || b >= NUM_BUCKETS || op < 0 || op >= MAX_OP)
+			continue;
+		counts_[prev][b][op] += count;
+		samples_ += count;
+	}
+	fclose(f);
+	update();
+	return true;
+}
+
+bool OrderModel::save(const char* path) const
+{
+	FILE* f = fopen(path, "w");
+	if (!f)
+		return false;
+	for (int prev = 0; prev < MAX_OP; prev++)
+		for (int b = 0; b < NUM_BUCKETS; b++)
+			for (int op = 0; op < MAX_OP; op++)
+				if (counts_[prev][b][op])
+					fprintf(f, "%d %d %d %d\n", prev, b, op, counts_[prev][b][op]);
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "gen2.h"
+
+#include <vector>
+
+// How likely every op is to come next in Arena's postfix emission, given
+// the op just emitted and the number of ops left, learnt from programs
+// known to be secrets. Arena tries ops by that order where the context was
+// seen often enough; every order is a permutation of all ops, so the
+// enumeration stays exhaustive.
+class OrderModel
+{
+public:
+	enum { NUM_BUCKETS = 5, NUM_OPS = TFOLD - FIRST_OP };
+
+	OrderModel();
+
+	void learn(Expr* program);
+	// text lines of "prev bucket op count".
+	bool load(const char* path);
+	bool save(const char* path) const;
+
+	// all ops, likeliest first, NULL if the context is too rare.
+	const Op* order(Op prev, int left_ops) const;
+	static int bucket(int left_ops);
+
+	long samples_;
+
+private:
+	void flatten(Expr* e, std::vector<Op>* ops, std::vector<int>* widths);
+	void learn_sequence(const std::vector<Op>& ops, const std::vector<int>& widths);
+	void update();
+
+	int counts_[MAX_OP][NUM_BUCKETS][MAX_OP];
+	Op orders_[MAX_OP][NUM_BUCKETS][NUM_OPS];
+	bool known_[MAX_OP][NUM_BUCKETS];
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "multi.h"
+#include "telemetry.h"
+
+Val MultiVerifier::hash(const Val* values, int n)
+{
+	Val h = 0xcbf29ce484222325ul;
+	for (int i = 0; i < n; i++) {
+		h ^= values[i];
+		h *= 0x9e3779b97f4a7c15ul;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+void MultiVerifier::add(Verifier* v, const Val* outputs)
+{
+	int k = verifiers_.size();
+	verifiers_.push_back(v);
+	done_.push_back(false);
+	problems_.insert(std::make_pair(hash(outputs, inputs_.size()), k));
+	first_.push_back(outputs[0]);
+	left_.push_back(k);
+	scratch_.resize(inputs_.size());
+}
+
+void MultiVerifier::finish(int k)
+{
+	done_[k] = true;
+	for (int i = 0; i < left_.size(); i++) {
+		if (left_[i] == k) {
+			left_.erase(left_.begin() + i);
+			first_.erase(first_.begin() + i);
+			break;
+		}
+	}
+}
+
+bool MultiVerifier::action(Expr* e, int size)
+{
+	checked_++;
+	if ((checked_ & 0xfffff) == 0 && deadline_ && Verifier::now_ms() > deadline_) {
+		printf("multi: out of time with %d problems left\n", (int)left_.size());
+		return false;
+	}
+
+	// a handful of problems: a scan beats any lookup.
+	Val first = e->run(inputs_[0]);
+	int i = 0;
+	while (i < first_.size() && first_[i] != first)
+		i++;
+	if (i == first_.size()) {
+		Telemetry::add(Telemetry::MULTI_SCAN_MISS);
+		return true;
+	}
+
+	scratch_[0] = first;
+	for (int j = 1; j < inputs_.size(); j++)
+		scratch_[j] = e->run(inputs_[j]);
+	std::pair<std::multimap<Val, int>::iterator, std::multimap<Val, int>::iterator> range =
+		problems_.equal_range(hash(&scratch_[0], inputs_.size()));
+	std::vector<int> matched;
+	for (std::multimap<Val, int>::iterator it = range.first; it != range.second; ++it)
+		if (!done_[it->second])
+			matched.push_back(it->second);
+	if (matched.empty())
+		Telemetry::add(Telemetry::MULTI_HASH_MISS);
+	for (int m = 0; m < matched.size(); m++) {
+		routed_++;
+		Telemetry::add(Telemetry::MULTI_ROUTED);
+		if (!verifiers_[matched[m]]->action(e, size))
+			finish(matched[m]);
+	}
+	return !left_.empty();
+}
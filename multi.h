@@ -0,0 +1,47 @@
+#ifndef MULTI_H
+#define MULTI_H
+
+#include "gen2.h"
+
+#include <map>
+#include <vector>
+
+// Checks every candidate of a single enumeration against many problems of
+// the same size and ops at once. All problems are evaluated on the same
+// inputs; a candidate is run on the first one and dropped unless some
+// problem has that output, then its outputs on all of them are hashed and
+// looked up. Only matching problems see the candidate, through their own
+// verifier, which guesses it.
+class MultiVerifier : public Callback
+{
+public:
+	MultiVerifier() : checked_(0), routed_(0), deadline_(0) {}
+
+	void set_inputs(const std::vector<Val>& inputs) { inputs_ = inputs; }
+	// outputs on the shared inputs; v is done once its action returns false.
+	void add(Verifier* v, const Val* outputs);
+	// in Verifier::now_ms() time, 0 for never.
+	void set_deadline(long ms) { deadline_ = ms; }
+
+	virtual bool action(Expr* e, int size);
+	int left() const { return left_.size(); }
+	bool done(int k) const { return done_[k]; }
+
+	long checked_;
+	long routed_;
+
+private:
+	static Val hash(const Val* values, int n);
+	void finish(int k);
+
+	std::vector<Val> inputs_;
+	std::vector<Verifier*> verifiers_;
+	std::vector<bool> done_;
+	std::multimap<Val, int> problems_; // by hash of all outputs
+	std::vector<Val> first_;           // outputs on the first input, of problems left
+	std::vector<int> left_;
+	std::vector<Val> scratch_;
+	long deadline_;
+};
+
+#endif
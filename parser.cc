@@ -0,0 +1,119 @@
+#include "parser.h"
+
+#include <ctype.h>
+#include <string.h>
+
+Op Parser::op(const string& name)
+{
+	static const struct { const char* name; Op op; } ops[] = {
+		{ "if0", IF0 }, { "fold", FOLD }, { "not", NOT }, { "shl1", SHL1 },
+		{ "shr1", SHR1 }, { "shr4", SHR4 }, { "shr16", SHR16 }, { "and", AND },
+		{ "or", OR }, { "xor", XOR }, { "plus", PLUS }
+	};
+	for (int i = 0; i < sizeof(ops) / sizeof(*ops); i++)
+		if (name == ops[i].name)
+			return ops[i].op;
+	return DUMMY_OP;
+}
+
+Expr* Parser::parse(const string& text, ExprPool* pool)
+{
+	p_ = text.c_str();
+	pool_ = pool;
+	scope_.clear();
+	error_.clear();
+	Expr* e = lambda(1);
+	string rest;
+	if (e && next(&rest)) {
+		error_ = "trailing " + rest;
+		return NULL;
+	}
+	return e;
+}
+
+bool Parser::next(string* token)
+{
+	while (isspace(*p_))
+		p_++;
+	if (!*p_)
+		return false;
+	const char* start = p_;
+	if (*p_ == '(' || *p_ == ')')
+		p_++;
+	else
+		while (*p_ && !isspace(*p_) && *p_ != '(' && *p_ != ')')
+			p_++;
+	token->assign(start, p_ - start);
+	return true;
+}
+
+bool Parser::expect(const char* token)
+{
+	string t;
+	if (next(&t) && t == token)
+		return true;
+	if (error_.empty())
+		error_ = string("expected ") + token + " at " + t;
+	return false;
+}
+
+// (lambda (a b) body), the params pushed in order.
+Expr* Parser::lambda(int params)
+{
+	if (!expect("(") || !expect("lambda") || !expect("("))
+		return NULL;
+	for (int i = 0; i < params; i++) {
+		string name;
+		if (!next(&name) || name == "(" || name == ")") {
+			error_ = "bad lambda parameter " + name;
+			return NULL;
+		}
+		scope_.push_back(name);
+	}
+	if (!expect(")"))
+		return NULL;
+	Expr* body = expr();
+	if (!body || !expect(")"))
+		return NULL;
+	scope_.resize(scope_.size() - params);
+	return body;
+}
+
+Expr* Parser::expr()
+{
+	string t;
+	if (!next(&t)) {
+		error_ = "unexpected end";
+		return NULL;
+	}
+	if (t == "0")
+		return pool_->make(C0);
+	if (t == "1")
+		return pool_->make(C1);
+	if (t != "(") {
+		// the innermost binding wins.
+		for (int i = scope_.size() - 1; i >= 0; i--)
+			if (scope_[i] == t)
+				return pool_->var(i);
+		error_ = "unbound " + t;
+		return NULL;
+	}
+
+	string name;
+	next(&name);
+	Op op = Parser::op(name);
+	if (op == DUMMY_OP) {
+		error_ = "unknown op " + name;
+		return NULL;
+	}
+	Expr* opnd[3] = { NULL, NULL, NULL };
+	int arity = Expr::arity(op);
+	for (int i = 0; i < arity; i++) {
+		opnd[i] = op == FOLD && i == 2 ? lambda(2) : expr();
+		if (!opnd[i])
+			return NULL;
+	}
+	if (!expect(")"))
+		return NULL;
+	return pool_->make(op, opnd[0], opnd[1], opnd[2]);
+}
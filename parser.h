@@ -0,0 +1,36 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <map>
+#include <vector>
+
+// Reads \BV programs back into Expr trees, e.g. from logs, caches or
+// problem files. Lambda variables may have any name; they are numbered by
+// their depth in the evaluation Context, so the outer one is x0 and the
+// fold lambda's ones are x1 and x2, as the generators emit them.
+class Parser
+{
+public:
+	// NULL on a syntax error, which is then in error_.
+	Expr* parse(const string& text, ExprPool* pool);
+
+	// DUMMY_OP for anything but the \BV op names.
+	static Op op(const string& name);
+
+	string error_;
+
+private:
+	bool next(string* token);
+	bool expect(const char* token);
+	Expr* expr();
+	Expr* lambda(int params);
+
+	const char* p_;
+	ExprPool* pool_;
+	std::vector<string> scope_;
+};
+
+#endif
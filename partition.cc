@@ -0,0 +1,190 @@
+#include "partition.h"
+
+#include <stdio.h>
+#include <map>
+
+PartitionSolver::PartitionSolver()
+{
+	verifier_ = NULL;
+	bonus_ = false;
+	depth_ = 2;
+	max_steps_ = 50000000;
+	steps_ = 0;
+	words_ = 0;
+	n_ = 0;
+	next_poll_ = 0;
+	expired_ = false;
+}
+
+void PartitionSolver::reset(int size)
+{
+	std::vector<Val> inputs;
+	outputs_.clear();
+	Bank::pick_pairs(verifier_->get_pairs(), &inputs, &outputs_);
+	n_ = inputs.size();
+	words_ = (n_ + 63) / 64;
+
+	// parts are fold-free, the if0s are added here.
+	bank_.allowed_ops_ = allowed_ops_;
+	bank_.allowed_ops_.del(FOLD);
+	bank_.set_inputs(inputs);
+	bank_.set_deadline(verifier_->deadline());
+	// no part is larger than the whole body.
+	bank_.grow(size - 1);
+	pool_.clear();
+	classify();
+}
+
+void PartitionSolver::classify()
+{
+	// keep the smallest term for every set of pairs it gets right, and for
+	// every way a condition splits the pairs. Terms come ordered by size.
+	std::map<Set, int> seen_match;
+	std::map<Set, int> seen_zero;
+	progs_.clear();
+	matches_.clear();
+	splits_.clear();
+	by_pair_.assign(n_, std::vector<int>());
+	for (int t = 0; t < bank_.count(); t++) {
+		const Val* v = bank_.values(t);
+		Set match(words_, 0);
+		Set zero(words_, 0);
+		int zeros = 0;
+		bool any = false;
+		for (int i = 0; i < n_; i++) {
+			if (v[i] == outputs_[i]) {
+				match[i / 64] |= 1ul << (i % 64);
+				any = true;
+			}
+			if ((bonus_ ? v[i] & 1 : v[i]) == 0) {
+				zero[i / 64] |= 1ul << (i % 64);
+				zeros++;
+			}
+		}
+		if (any && seen_match.insert(std::make_pair(match, t)).second) {
+			for (int i = 0; i < n_; i++)
+				if (match[i / 64] & (1ul << (i % 64)))
+					by_pair_[i].push_back(progs_.size());
+			progs_.push_back(t);
+			matches_.push_back(match);
+		}
+		if (zeros && zeros < n_ && seen_zero.insert(std::make_pair(zero, t)).second) {
+			Split split;
+			split.cond = t;
+			split.zero = zero;
+			splits_.push_back(split);
+		}
+	}
+	printf("partition: %d terms, %d programs, %d splits\n", bank_.count(), (int)progs_.size(), (int)splits_.size());
+}
+
+bool PartitionSolver::spent()
+{
+	// the clock is read only once in a while.
+	if (steps_ >= next_poll_) {
+		next_poll_ = steps_ + 65536;
+		expired_ = expired_ || !verifier_->poll();
+	}
+	return expired_ || steps_ >= max_steps_;
+}
+
+bool PartitionSolver::subset(const Set& a, const Set& b) const
+{
+	for (int w = 0; w < words_; w++)
+		if (a[w] & ~b[w])
+			return false;
+	return true;
+}
+
+int PartitionSolver::single(const Set& s, int size)
+{
+	steps_++;
+	// only programs right on the rarest pair of s can cover it.
+	const std::vector<int>* rarest = NULL;
+	for (int i = 0; i < n_; i++)
+		if ((s[i / 64] & (1ul << (i % 64))) && (!rarest || by_pair_[i].size() < rarest->size()))
+			rarest = &by_pair_[i];
+	if (!rarest)
+		return -1;
+	for (int k = 0; k < (int)rarest->size(); k++) {
+		int p = (*rarest)[k];
+		if (bank_.term(progs_[p]).size > size)
+			break;
+		if (subset(s, matches_[p]))
+			return progs_[p];
+	}
+	return -1;
+}
+
+int PartitionSolver::cond_size(int t)
+{
+	// (and X 1)
+	return bank_.term(t).size + (bonus_ ? 2 : 0);
+}
+
+Expr* PartitionSolver::make_cond(int t)
+{
+	Expr* x = bank_.build(t, &pool_);
+	return bonus_ ? pool_.make(AND, x, pool_.make(C1)) : x;
+}
+
+Expr* PartitionSolver::cover(const Set& s, int size, int depth)
+{
+	int t = single(s, size);
+	if (t >= 0)
+		return bank_.build(t, &pool_);
+	if (depth == 0 || size < 4)
+		return NULL;
+
+	Expr* best = NULL;
+	int best_size = size + 1;
+	Set then_set(words_), else_set(words_);
+	for (int k = 0; k < (int)splits_.size() && !spent(); k++) {
+		const Split& split = splits_[k];
+		int left = best_size - 2 - cond_size(split.cond);
+		if (left < 2)
+			break; // splits are ordered by size too
+		bool empty_then = true, empty_else = true;
+		for (int w = 0; w < words_; w++) {
+			then_set[w] = s[w] & split.zero[w];
+			else_set[w] = s[w] & ~split.zero[w];
+			empty_then = empty_then && !then_set[w];
+			empty_else = empty_else && !else_set[w];
+		}
+		if (empty_then || empty_else)
+			continue;
+
+		int p = single(then_set, left - 1);
+		if (p < 0)
+			continue;
+		Expr* e = cover(else_set, left - bank_.term(p).size, depth - 1);
+		if (!e)
+			continue;
+		best = pool_.make(IF0, make_cond(split.cond), bank_.build(p, &pool_), e);
+		best_size = ExprPool::size(best);
+	}
+	return best;
+}
+
+bool PartitionSolver::generate(int size)
+{
+	for (;;) {
+		size_t seen = verifier_->get_pairs().size();
+		reset(size);
+
+		Set all(words_, 0);
+		for (int i = 0; i < n_; i++)
+			all[i / 64] |= 1ul << (i % 64);
+		Expr* e = NULL;
+		for (int depth = 0; !e && depth <= depth_; depth++)
+			e = cover(all, size - 1, depth);
+		if (!e)
+			return false;
+		if (!verifier_->action(e, ExprPool::size(e) + 1))
+			return true;
+		if (!verifier_->settle())
+			return true;
+		if (verifier_->get_pairs().size() == seen)
+			return false;
+	}
+}
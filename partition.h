@@ -0,0 +1,68 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <vector>
+
+// Decomposes the I/O pairs instead of enumerating if0 operands jointly.
+// Bank terms are grouped by the set of pairs they get right, then a
+// condition splitting the pairs is searched so that each side is covered by
+// one term (or, nested, by another split). For bonus problems the condition
+// has the fixed shape (and X 1).
+class PartitionSolver
+{
+public:
+	PartitionSolver();
+
+	void set_callback(Verifier* v) { verifier_ = v; }
+	void set_bonus(bool bonus) { bonus_ = bonus; }
+	void set_depth(int depth) { depth_ = depth; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+
+	// true if the callback asked to stop.
+	bool generate(int size);
+
+	OpSet allowed_ops_;
+	long max_steps_;
+	long steps_;
+
+private:
+	typedef std::vector<Val> Set; // one bit per pair
+
+	struct Split {
+		int cond;   // bank term
+		Set zero;   // pairs where the condition is 0
+	};
+
+	void reset(int size);
+	void classify();
+	// out of steps or past the verifier's deadline.
+	bool spent();
+	// smallest expression covering s, depth is the number of ifs left.
+	Expr* cover(const Set& s, int size, int depth);
+	int single(const Set& s, int size);
+	Expr* make_cond(int t);
+	int cond_size(int t);
+
+	bool subset(const Set& a, const Set& b) const;
+
+	Verifier* verifier_;
+	Bank bank_;
+	ExprPool pool_;
+	bool bonus_;
+	int depth_;
+	int words_;
+	int n_;
+	std::vector<Val> outputs_; // on the bank's inputs
+	long next_poll_;
+	bool expired_;
+
+	std::vector<int> progs_;   // terms with distinct match sets, by size
+	std::vector<Set> matches_;
+	std::vector<Split> splits_;
+	std::vector< std::vector<int> > by_pair_; // programs right on each pair
+};
+
+#endif
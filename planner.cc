@@ -0,0 +1,193 @@
+#include "planner.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <set>
+
+// fixed inputs to tell apart programs that only differ in their code.
+static const Val fingerprint_inputs[] = {
+	0x0, 0xffffffffffffffff, 0x5a3c96e1d2b4f807, 0x0123456789abcdef,
+	0x8000000000000001, 0x00000000000000ff, 0xfedcba9876543210, 0x7e1f00ff3c5aa5c3
+};
+
+// keeps a copy of every new function agreeing with all pairs.
+class Collector : public Verifier
+{
+public:
+	Collector(ExprPool* pool, std::vector<Expr*>* out, int max, long max_programs)
+		: programs_(0), pool_(pool), out_(out), max_(max), max_programs_(max_programs) {}
+
+	virtual bool action(Expr* e, int size)
+	{
+		if (++programs_ > max_programs_)
+			return false;
+		for (Pairs::iterator it = pairs.begin(); it != pairs.end(); ++it)
+			if (e->run(it->first) != it->second)
+				return true;
+		if (seen_.insert(Planner::fingerprint(e)).second)
+			out_->push_back(pool_->clone(e));
+		return (int)out_->size() < max_;
+	}
+
+	long programs_;
+
+private:
+	ExprPool* pool_;
+	std::vector<Expr*>* out_;
+	std::set<Val> seen_;
+	int max_;
+	long max_programs_;
+};
+
+Val Planner::fingerprint(Expr* e)
+{
+	Val h = 0;
+	for (int i = 0; i < sizeof(fingerprint_inputs) / sizeof(*fingerprint_inputs); i++)
+		h = (h ^ e->run(fingerprint_inputs[i])) * 0x9e3779b97f4a7c15ul;
+	return h;
+}
+
+Planner::Planner()
+{
+	verifier_ = NULL;
+	mode_tfold_ = false;
+	mode_bonus_ = false;
+	max_candidates_ = 256;
+	max_programs_ = 2000000;
+	exhaustive_ = false;
+	rng_ = 0x2545f4914f6cdd1dul;
+}
+
+int Planner::sample(int size)
+{
+	candidates_.clear();
+	pool_.clear();
+
+	Collector collector(&pool_, &candidates_, max_candidates_, max_programs_);
+	Observed observed;
+	const Verifier::Pairs& pairs = verifier_->get_pairs();
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+		collector.add(it->first, it->second);
+		observed.add(it->second);
+	}
+
+	if (mode_tfold_) {
+		ArenaTfold a;
+		a.set_callback(&collector);
+		a.allowed_ops_ = allowed_ops_;
+		a.set_observed(observed);
+		a.generate(size);
+		exhaustive_ = !a.done_;
+	} else if (mode_bonus_) {
+		ArenaBonus a;
+		a.set_callback(&collector);
+		a.allowed_ops_ = allowed_ops_;
+		a.set_observed(observed);
+		a.generate(size);
+		exhaustive_ = !a.done_;
+	} else {
+		Arena a;
+		a.set_callback(&collector);
+		a.allowed_ops_ = allowed_ops_;
+		a.set_observed(observed);
+		a.generate(size);
+		exhaustive_ = !a.done_;
+	}
+	return candidates_.size();
+}
+
+void Planner::fill_pool()
+{
+	inputs_.clear();
+	static const Val patterns[] = {
+		0x0, 0xffffffffffffffff, 0x5555555555555555, 0xaaaaaaaaaaaaaaaa,
+		0x3333333333333333, 0xcccccccccccccccc, 0x0f0f0f0f0f0f0f0f, 0xf0f0f0f0f0f0f0f0,
+		0x00ff00ff00ff00ff, 0xff00ff00ff00ff00, 0x0000ffff0000ffff, 0xffff0000ffff0000,
+		0x00000000ffffffff, 0xffffffff00000000, 0x8000000000000000, 0x1
+	};
+	for (int i = 0; i < sizeof(patterns) / sizeof(*patterns); i++)
+		inputs_.push_back(patterns[i]);
+	for (int i = 1; i < 64; i += 3) {
+		inputs_.push_back(1ul << i);
+		inputs_.push_back((1ul << i) - 1);
+	}
+	while (inputs_.size() < 512) {
+		rng_ ^= rng_ << 13;
+		rng_ ^= rng_ >> 7;
+		rng_ ^= rng_ << 17;
+		// sparse and dense ones as well as uniform ones.
+		Val v = rng_;
+		switch (inputs_.size() % 4) {
+		case 1: v &= v >> 7; break;
+		case 2: v |= v >> 7; break;
+		case 3: v &= 0xff; break;
+		}
+		inputs_.push_back(v);
+	}
+}
+
+void Planner::plan(int n, std::vector<Val>* inputs)
+{
+	split(candidates_, n, inputs);
+}
+
+int Planner::split(const std::vector<Expr*>& candidates, int n, std::vector<Val>* inputs, std::vector<Val>* rest)
+{
+	if (inputs_.empty())
+		fill_pool();
+
+	// inputs already asked about or picked tell nothing new.
+	std::set<Val> known;
+	const Verifier::Pairs& pairs = verifier_->get_pairs();
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it)
+		known.insert(it->first);
+	for (int i = 0; i < (int)inputs->size(); i++)
+		known.insert((*inputs)[i]);
+	std::vector<Val> pool;
+	for (int p = 0; p < (int)inputs_.size(); p++)
+		if (known.find(inputs_[p]) == known.end())
+			pool.push_back(inputs_[p]);
+
+	int c = candidates.size();
+	int np = pool.size();
+	std::vector<Val> outputs((size_t)np * c);
+	for (int p = 0; p < np; p++)
+		for (int k = 0; k < c; k++)
+			outputs[(size_t)p * c + k] = candidates[k]->run(pool[p]);
+
+	// class of every candidate under the inputs picked so far.
+	std::vector<Val> sig(c, 0), next(c);
+	std::vector<bool> taken(np, false);
+	int classes = 1;
+	int picked = 0;
+	while (picked < n && c > 1) {
+		int best = -1, best_classes = classes;
+		for (int p = 0; p < np; p++) {
+			if (taken[p])
+				continue;
+			for (int k = 0; k < c; k++)
+				next[k] = (sig[k] ^ outputs[(size_t)p * c + k]) * 0x9e3779b97f4a7c15ul;
+			std::sort(next.begin(), next.end());
+			int count = std::unique(next.begin(), next.end()) - next.begin();
+			if (count > best_classes) {
+				best_classes = count;
+				best = p;
+			}
+		}
+		// nothing splits the candidates any further.
+		if (best < 0)
+			break;
+		for (int k = 0; k < c; k++)
+			sig[k] = (sig[k] ^ outputs[(size_t)best * c + k]) * 0x9e3779b97f4a7c15ul;
+		classes = best_classes;
+		taken[best] = true;
+		inputs->push_back(pool[best]);
+		picked++;
+	}
+
+	if (rest)
+		for (int p = 0; p < np; p++)
+			if (!taken[p])
+				rest->push_back(pool[p]);
+	return picked;
+}
@@ -0,0 +1,58 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <vector>
+
+// Picks eval inputs that tell apart the programs still consistent with the
+// known pairs. Candidates are sampled from the enumerator, run on a pool of
+// inputs, and inputs are taken greedily by how many more classes of
+// candidates they split off. Meant to be called again after every eval
+// response, with the new pairs added to the verifier.
+class Planner
+{
+public:
+	Planner();
+
+	void set_verifier(Verifier* v) { verifier_ = v; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+	void set_max_candidates(int n) { max_candidates_ = n; }
+	void set_max_programs(long n) { max_programs_ = n; }
+
+	// collects up to max_candidates programs agreeing with all pairs.
+	int sample(int size);
+	// the last sample holds every program agreeing with all pairs.
+	bool exhaustive() const { return exhaustive_; }
+	const std::vector<Expr*>& candidates() const { return candidates_; }
+
+	// appends up to n inputs splitting the sampled candidates, best first,
+	// and none once they are all told apart.
+	void plan(int n, std::vector<Val>* inputs);
+	// appends only inputs splitting the given candidates, up to n of them,
+	// and returns how many. The unused pool inputs go to rest.
+	int split(const std::vector<Expr*>& candidates, int n, std::vector<Val>* inputs,
+		std::vector<Val>* rest = NULL);
+
+	// outputs on a few fixed inputs, equal for most equivalent programs.
+	static Val fingerprint(Expr* e);
+
+	OpSet allowed_ops_;
+	bool mode_tfold_;
+	bool mode_bonus_;
+
+private:
+	void fill_pool();
+
+	Verifier* verifier_;
+	ExprPool pool_;
+	std::vector<Expr*> candidates_;
+	std::vector<Val> inputs_; // the pool
+	int max_candidates_;
+	long max_programs_;
+	bool exhaustive_;
+	Val rng_;
+};
+
+#endif
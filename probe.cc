@@ -0,0 +1,90 @@
+#include "probe.h"
+
+#include <stdio.h>
+
+Probe::Probe()
+{
+	learnt_ = false;
+	base_ = 0;
+	max_down_ = 0;
+	max_up_ = 0;
+	constant_ = false;
+	memset(dep_, 0, sizeof(dep_));
+	memset(byte_dep_, 0, sizeof(byte_dep_));
+}
+
+void Probe::make_inputs(Val base, std::vector<Val>* inputs)
+{
+	base_ = base;
+	inputs->push_back(base);
+	for (int i = 0; i < 64; i++)
+		inputs->push_back(base ^ (1ul << i));
+	for (int k = 0; k < 8; k++)
+		inputs->push_back(base ^ (0xfful << (k * 8)));
+}
+
+void Probe::learn(const Val* in, const Val* out, int n)
+{
+	int b = -1;
+	for (int j = 0; j < n && b < 0; j++)
+		if (in[j] == base_)
+			b = j;
+	if (b < 0)
+		return;
+
+	Val base_out = out[b];
+	for (int j = 0; j < n; j++) {
+		Val flip = in[j] ^ base_;
+		if (!flip)
+			continue;
+		int low = __builtin_ctzll(flip);
+		if (!(flip & (flip - 1)))
+			dep_[low] = out[j] ^ base_out;
+		else if (low % 8 == 0 && flip >> low == 0xff)
+			byte_dep_[low / 8] = out[j] ^ base_out;
+	}
+
+	max_down_ = max_up_ = 0;
+	Val any = 0;
+	for (int i = 0; i < 64; i++) {
+		Val d = dep_[i];
+		any |= d;
+		if (!d)
+			continue;
+		int low = __builtin_ctzll(d);
+		int top = 63 - __builtin_clzll(d);
+		if (i - low > max_down_)
+			max_down_ = i - low;
+		if (top - i > max_up_)
+			max_up_ = top - i;
+	}
+	for (int k = 0; k < 8; k++)
+		any |= byte_dep_[k];
+	constant_ = !any;
+	learnt_ = true;
+}
+
+OpSet Probe::unlikely(OpSet allowed) const
+{
+	OpSet ops;
+	if (!learnt_ || allowed.has(IF0) || allowed.has(FOLD))
+		return ops;
+	// a few shl1 may take back part of a right shift.
+	int reach = max_down_ + (allowed.has(SHL1) ? 3 : 0);
+	if (reach < 16)
+		ops.add(SHR16);
+	if (reach < 4)
+		ops.add(SHR4);
+	if (reach < 1)
+		ops.add(SHR1);
+	if (max_up_ < 1 && max_down_ < 1)
+		ops.add(SHL1);
+	return ops;
+}
+
+void Probe::print() const
+{
+	if (!learnt_)
+		return;
+	printf("probe: reach down %d up %d%s\n", max_down_, max_up_, constant_ ? " constant" : "");
+}
@@ -0,0 +1,39 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "gen2.h"
+
+#include <vector>
+
+// Sensitivity probing: a base input, its 64 single bit flips and its 8 byte
+// flips are sent along with the other eval inputs. Comparing the outputs
+// with the base one gives, for every input bit, the output bits it reaches.
+// Bits reached only downwards by less than 16 say no shr16 is needed, and
+// so on. These are hints taken at a single point, so the ops they rule out
+// are only left for a first, cheaper pass.
+class Probe
+{
+public:
+	Probe();
+
+	// appends the probe inputs around base.
+	void make_inputs(Val base, std::vector<Val>* inputs);
+	void learn(const Val* in, const Val* out, int n);
+
+	// ops not needed according to the probes, none if if0 or fold are
+	// allowed as they don't keep bits in place.
+	OpSet unlikely(OpSet allowed) const;
+	void print() const;
+
+	bool learnt_;
+	Val dep_[64];      // output bits that change when input bit i flips
+	Val byte_dep_[8];  // same for a whole byte
+	int max_down_;     // farthest an input bit reaches to the right
+	int max_up_;       // and to the left
+	bool constant_;
+
+private:
+	Val base_;
+};
+
+#endif
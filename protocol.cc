@@ -2,6 +2,19 @@
 
 #include "gen2.h"
 #include "analyzer.h"
+#include "rules.h"
+#include "recognizer.h"
+#include "probe.h"
+#include "planner.h"
+#include "cache.h"
+#include "parser.h"
+#include "library.h"
+#include "multi.h"
+#include "model.h"
+#include "store.h"
+#include "codec.h"
+#include "eventlog.h"
+#include "telemetry.h"
 
 #include <inttypes.h>
 #include <stdio.h>
@@ -10,8 +23,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include <memory.h>
 #include <sstream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
 
 using std::stringstream;
 using std::ostream;
@@ -33,6 +52,8 @@ long timestamp()
 
 long started_;
 
+static Json::Value operators_of(const string& ops);
+
 class Protocol
 {
 public:
@@ -45,23 +66,45 @@ public:
 
     void print_tasks();
     void solve_my_tasks(int up_to_size);
-
-    void guess(const string& id, const string &program, Json::Value& result);
+    // unsolved tasks of the same size and ops share one enumeration.
+    void solve_groups(int size, int max_group);
+
+    void guess(const string& id, const string &program, Codec::Guess* result);
+    // false on a failed request or a non-ok status.
+    bool eval(const string& id, const Val* inputs, int n, Val* outputs);
+
+    void load_cache(const char* path);
+    void load_library(const char* path);
+    void load_model(const char* path);
+    void open_store(const char* path);
+    // merges the server's problem list into the store.
+    void retrieve_my_tasks();
+    // counts op choices of the cached programs into a model file.
+    void learn_model(const char* path);
+    void import_log(const char* path);
+    // where the API lives, e.g. a mock.cc server.
+    void set_base_url(const char* url) { base_url_ = url; }
 
 private:
-    bool send(const char* command, const Json::Value& request, Json::Value& result);
+    // the response body goes to response_.
+    bool post(const char* command, const string& body);
 
     void get_data(const char* data, size_t len);
-    void retrieve_my_tasks();
 
     static size_t response(void *ptr, size_t size, size_t nmemb, void *user_data);
 
     CURL *curl;
-    ostream* stream_;
-    Json::Value my_tasks_;
+    string base_url_;
+    Codec codec_;
+    string response_;
+    ProblemStore store_;
+    SolutionCache cache_;
+    Library library_;
+    OrderModel model_;
 };
 
 Protocol::Protocol()
+    : base_url_("http://icfpc2013.cloudapp.net")
 {
     curl = curl_easy_init();
     if (!curl) {
@@ -77,31 +120,60 @@ Protocol::~Protocol()
 
 void Protocol::train(int size)
 {
-    Json::Value request;
-    request["size"] = size;
-    request["operators"] = "fold";//Json::Value(Json::arrayValue);
-
-    Json::Value result;
-    if (!send("train", request, result)) {
+    Codec::Problem task;
+    if (!post("train", codec_.train_request(size, "fold")) ||
+            !Codec::parse_problem(response_.data(), response_.size(), &task)) {
         fprintf(stderr, "Task aquisition failed\n");
         return;
     }
 
-    printf("got train task:\n%s\n", result.toStyledString().c_str());
+    printf("got train task:\n%s\n", response_.c_str());
+    if (!task.challenge.empty())
+        cache_.add(task.challenge);
 
-    challenge(result["id"].asCString(), result["size"].asInt(), result["operators"]);
+    challenge(task.id, task.size, operators_of(task.operators));
 }
 
 class Solver : public Verifier
 {
 public:
-    Solver(const string& id, Protocol* protocol) : id_(id), protocol_(protocol), win_(false) {}
+    Solver(const string& id, Protocol* protocol)
+        : id_(id), protocol_(protocol), win_(false), guesses_(0), batches_(0),
+          max_batch_(0), slice_ms_(0), stopped_(false), first_at_(0) { planner_.set_verifier(this); }
     virtual bool action(Expr* program, int size);
+    // held candidates are resolved once slice_ms_ is up, whether or not
+    // more candidates come.
+    virtual bool poll();
+    virtual bool settle();
+    // resolves the candidates still held back, true if there were some and
+    // none of them won, so another search may find more.
+    bool flush();
 
     Protocol* protocol_;
     string id_;
     bool win_;
+    string winner_;
     long cnt;
+    int guesses_;
+    int batches_;
+    // with max_batch_ set, consistent candidates are held until there are
+    // that many or slice_ms_ passed since the first one, told apart with a
+    // single eval and only the survivors are guessed.
+    int max_batch_;
+    long slice_ms_;
+
+private:
+    bool consistent(Expr* program);
+    // false when to stop the search.
+    bool guess(Expr* program, int size);
+    bool resolve();
+
+    Planner planner_;
+    ExprPool pool_;
+    std::vector<Expr*> batch_;
+    std::set<Val> seen_;
+    bool stopped_; // won, or the server said no more
+    long first_at_;
 };
 
 bool Solver::action(Expr* program, int size)
@@ -109,48 +181,182 @@ bool Solver::action(Expr* program, int size)
     cnt++;
     if ((cnt & 0x7fffff) == 0) {
         long ts = timestamp();
-        long elapsed = ts - started_;
-        printf("??? %6lu ms  %9lu: [%d] %s     \n",
-            elapsed, cnt, size, program->program().c_str());
-        fflush(stdout);
-        if (elapsed > 320 * 1000) {
+        EventLog::candidate(cnt, size, program->program());
+        if (deadline_ && ts > deadline_) {
             printf("\n ===================== TIME IS OUT :-(( ========================\n\n");
             return false;
         }
     }
+    if (!batch_.empty() && timestamp() - first_at_ > slice_ms_)
+        if (!resolve())
+            return false;
+    bool ok;
+    if ((cnt & (Telemetry::EVAL_SAMPLING - 1)) == 0) {
+        uint64_t t = Telemetry::now_ns();
+        ok = consistent(program);
+        Telemetry::add(Telemetry::EVAL_NS, Telemetry::now_ns() - t);
+        Telemetry::add(Telemetry::EVAL_SAMPLES);
+    } else
+        ok = consistent(program);
+    if (!ok)
+        return true;
+    if (!max_batch_)
+        return guess(program, size);
+
+    if (seen_.insert(Planner::fingerprint(program)).second) {
+        printf("held %d: [%d] %s\n", (int)batch_.size(), size, program->program().c_str());
+        if (batch_.empty())
+            first_at_ = timestamp();
+        batch_.push_back(pool_.clone(program));
+    }
+    if (batch_.size() >= max_batch_ || timestamp() - first_at_ > slice_ms_)
+        return resolve();
+    return true;
+}
+
+bool Solver::poll()
+{
+    if (!batch_.empty() && timestamp() - first_at_ > slice_ms_)
+        resolve();
+    return !stopped_ && Verifier::poll();
+}
+
+bool Solver::settle()
+{
+    if (!batch_.empty())
+        resolve();
+    return !stopped_ && Verifier::poll();
+}
+
+bool Solver::flush()
+{
+    if (batch_.empty())
+        return false;
+    return resolve() && !win_;
+}
+
+bool Solver::consistent(Expr* program)
+{
     for (Pairs::iterator it = pairs.begin(); it != pairs.end(); ++it) {
         Val actual = program->run((*it).first);
-        if (actual != (*it).second)
-            return true;
+        if (actual != (*it).second) {
+            Telemetry::add(it == pairs.begin() ? Telemetry::VERIFY_FIRST : Telemetry::VERIFY_LATER);
+            return false;
+        }
+    }
+    Telemetry::add(Telemetry::VERIFY_PASSED);
+    return true;
+}
+
+bool Solver::resolve()
+{
+    batches_++;
+    std::vector<Val> next;
+    if (batch_.size() > 1)
+        planner_.split(batch_, 256, &next);
+    printf("batch %d: %d candidates, %d inputs to tell them apart at %lu ms\n",
+        batches_, (int)batch_.size(), (int)next.size(), timestamp() - started_);
+    if (!next.empty()) {
+        std::vector<Val> outputs(next.size());
+        if (protocol_->eval(id_, &next[0], next.size(), &outputs[0]))
+            for (int i = 0; i < next.size(); i++)
+                add(next[i], outputs[i]);
     }
+
+    // the first found, thus usually the smallest, survivor goes first.
+    std::vector<Expr*> batch;
+    batch.swap(batch_);
+    seen_.clear();
+    bool go_on = true;
+    for (int k = 0; k < batch.size() && go_on; k++)
+        if (consistent(batch[k]))
+            go_on = guess(batch[k], ExprPool::size(batch[k]) + 1);
+    pool_.clear();
+    return go_on;
+}
+
+bool Solver::guess(Expr* program, int size)
+{
     printf("\n!!! %6lu: [%d] %s    \n",
         cnt, size, program->program().c_str());
 
-    Json::Value result;
-    protocol_->guess(id_, program->program(), result);
+    Codec::Guess result;
+    guesses_++;
+    protocol_->guess(id_, program->program(), &result);
 
-    if (result["status"] == "win") {
+    if (result.status == "win") {
         win_ = true;
+        stopped_ = true;
+        winner_ = program->program();
         return false;
     }
 
-    if (result["status"] == "mismatch") {
-        Json::Value values = result["values"];
-        Val inp, out;
-        sscanf(values[0u].asCString(), "%"PRIx64, &inp);
-        sscanf(values[1u].asCString(), "%"PRIx64, &out);
+    if (result.status == "mismatch" && result.num_values >= 2) {
+        Val inp = result.values[0];
+        Val out = result.values[1];
         printf("parsed 0x%"PRIx64" 0x%"PRIx64"\n", inp, out);
         add(inp, out);
         return true;
     }
 
+    stopped_ = true;
     return false;
 }
 
+// the server's operator list back from the store's text.
+static Json::Value operators_of(const string& ops)
+{
+    Json::Value operators(Json::arrayValue);
+    stringstream stream(ops);
+    string op;
+    while (stream >> op)
+        operators.append(op);
+    return operators;
+}
+
+static void set_operators(const Json::Value& operators, Generator* g)
+{
+    for (int i = 0; i < operators.size(); i++) {
+        string ops = operators[i].asString();
+        Op op;
+        if (ops == "tfold") {
+            g->mode_tfold_ = true;
+            continue;
+        }
+        else if (ops == "xor") op = XOR;
+        else if (ops == "and") op = AND;
+        else if (ops == "plus") op = PLUS;
+        else if (ops == "or") op = OR;
+        else if (ops == "not") op = NOT;
+        else if (ops == "shl1") op = SHL1;
+        else if (ops == "shr1") op = SHR1;
+        else if (ops == "shr4") op = SHR4;
+        else if (ops == "shr16") op = SHR16;
+        else if (ops == "fold") op = FOLD;
+        else if (ops == "if0") op = IF0;
+        else if (ops == "bonus") {
+            g->mode_bonus_ = true;
+            continue;
+         //   g->allow_all();
+         //   break;
+        } else {
+            fprintf(stderr, "Unknow op %s in allowed ops... allowing all\n", ops.c_str());
+            exit(1);
+        }
+        g->add_allowed_op(op);
+    }
+}
+
 bool Protocol::challenge(const string& id, int size, const Json::Value& operators)
 {
     started_ = timestamp();
-    printf("Challenge ACCEPTED:\nid: %s\nsize: %d\noperators: %s", id.c_str(), size, operators.toStyledString().c_str());
+    Telemetry::Totals before;
+    Telemetry::read(&before);
+    string ops_str;
+    for (int i = 0; i < operators.size(); i++)
+        ops_str += (i ? " " : "") + operators[i].asString();
+    printf("Challenge ACCEPTED: %s size %d: %s\n", id.c_str(), size, ops_str.c_str());
+    EventLog::challenge(id, size, ops_str);
 
     Val inp[256];
     int inp_size = 0;
@@ -192,156 +398,309 @@ bool Protocol::challenge(const string& id, int size, const Json::Value& operator
     for (int i = 0; i < sizeof(inp1) / sizeof(*inp1); i++)
         inp[inp_size++] = inp1[i];
 
-    Json::Value inputs(Json::arrayValue);
-    for (int i = 0; i < inp_size; i++) {
-        char buffer[100];
-        snprintf(buffer, sizeof(buffer), "0x%"PRIx64, inp[i]);
-        inputs[i] = buffer;
-    }
-
-    Json::Value request;
-    Json::Value response;
-    request["id"] = id;
-    request["arguments"] = inputs;
-//    printf("req: %s\n", request.toStyledString().c_str());
-    send("eval", request, response);
-//    printf("res: %s\n", response.toStyledString().c_str());
-
-    if (response["status"].asString() != "ok") {
+    // sensitivity probes go in the same batch.
+    Probe probe;
+    std::vector<Val> probes;
+    probe.make_inputs(0x5A3C96E1D2B4F807, &probes);
+    for (int i = 0; i < probes.size(); i++)
+        inp[inp_size++] = probes[i];
+
+    // the cache fingerprints outputs on its own fixed inputs.
+    std::vector<Val> cache_probes;
+    SolutionCache::probe_inputs(&cache_probes);
+    int cache_at = inp_size;
+    for (int i = 0; i < cache_probes.size(); i++)
+        inp[inp_size++] = cache_probes[i];
+
+    Val outp[256];
+    if (!eval(id, inp, inp_size, outp)) {
         fprintf(stderr, "an error!!!\n");
         exit(1);
     }
+    probe.learn(inp, outp, inp_size);
+    probe.print();
+
     Generator g;
     Solver solver(id, this);
     Analyzer a;
     solver.cnt = 0;
+    solver.max_batch_ = 16;
+    solver.slice_ms_ = 1000;
+    // one deadline for every stage, a little before the server's 300 s.
+    solver.set_deadline(started_ + 290 * 1000);
 
-    int properties = 0;
-    Json::Value outputs = response["outputs"];
     for (int i = 0; i < inp_size; i++) {
-        Val out;
+        Val out = outp[i];
         Val in = inp[i];
-        sscanf(outputs[i].asCString(), "%"PRIx64, &out);
         solver.add(in, out);
         int d = a.distance(in, out);
 //        printf("  0x%016"PRIx64" -> 0x%016"PRIx64" : dist=%2d   0x%016"PRIx64"\n", in, out, d, in^out);
-        if (out & 1)   properties |= NO_TOP_SHL1;
-        if (out >> 63) properties |= NO_TOP_SHR1;
-        if (out >> 60) properties |= NO_TOP_SHR4;
-        if (out >> 48) properties |= NO_TOP_SHR16;
-        printf("  ");
-        for (int i = 0; i < 64; i++) {
-            printf("%d", in >= (1ul<<63));
-            in <<= 1;
+        g.add_output(out);
+    }
+    // pairs of an earlier run on this problem, mismatches included.
+    if (const ProblemStore::Problem* stored = store_.find(id)) {
+        std::set<Val> sent(inp, inp + inp_size);
+        for (int i = 0; i < stored->pairs.size(); i++) {
+            if (sent.count(stored->pairs[i].first))
+                continue;
+            solver.add(stored->pairs[i].first, stored->pairs[i].second);
+            g.add_output(stored->pairs[i].second);
+        }
+    }
+    printf("observed bits: one 0x%016" PRIx64 " zero 0x%016" PRIx64 "\n",
+        g.observed_.any_one, g.observed_.any_zero);
+
+    set_operators(operators, &g);
+    if (model_.samples_)
+        g.model_ = &model_;
+    //g.add_allowed_op(NOT);
+    g.unlikely_ops_ = probe.unlikely(g.allowed_ops_);
+
+    // a secret seen before is verified against all pairs and guessed.
+    std::vector<string> hits;
+    cache_.lookup(outp + cache_at, &hits);
+    printf("cache: %d of %d programs match at %lu ms\n", (int)hits.size(), cache_.count(), timestamp() - started_);
+    for (int i = 0; i < hits.size(); i++) {
+        ExprPool pool;
+        Parser parser;
+        Expr* e = parser.parse(hits[i], &pool);
+        if (e && !solver.action(e, ExprPool::size(e) + 1))
+            break;
+    }
+    solver.flush();
+    if (solver.win_) {
+        printf("\t\t\t\t\t\t\tCHALLENGE done from cache in %lu ms, %d guesses\n\n", timestamp() - started_, solver.guesses_);
+        return true;
+    }
+
+    // small problems are all in the library, keyed by the same outputs.
+    if (library_.is_open() && size <= library_.max_size() && !g.mode_bonus_) {
+        std::vector<const char*> found;
+        library_.lookup(outp + cache_at, Library::ops_mask(g.allowed_ops_, g.mode_tfold_), &found);
+        printf("library: %d programs match at %lu ms\n", (int)found.size(), timestamp() - started_);
+        for (int i = 0; i < found.size(); i++) {
+            ExprPool pool;
+            Parser parser;
+            Expr* e = parser.parse(found[i], &pool);
+            if (e && !solver.action(e, ExprPool::size(e) + 1))
+                break;
         }
-        printf(" -> ");
-        for (int i = 0; i < 64; i++) {
-            printf("%d", out >= (1ul<<63));
-            out <<= 1;
+        solver.flush();
+        if (solver.win_) {
+            printf("\t\t\t\t\t\t\tCHALLENGE done from library in %lu ms, %d guesses\n\n", timestamp() - started_, solver.guesses_);
+            cache_.add(solver.winner_);
+            return true;
         }
-        printf("\n");
     }
-    printf("properties = 0x%x\n", properties);
-    g.set_properties(properties);
 
-    for (int i = 0; i < operators.size(); i++) {
-        string ops = operators[i].asString();
-        Op op;
-        if (ops == "tfold") {
-            g.mode_tfold_ = true;
-            continue;
+    // the rest of the eval budget goes to inputs that split the programs
+    // still consistent, re-planned after every response.
+    Planner planner;
+    planner.set_verifier(&solver);
+    planner.allowed_ops_ = g.allowed_ops_;
+    planner.mode_tfold_ = g.mode_tfold_;
+    planner.mode_bonus_ = g.mode_bonus_;
+    for (int round = 0; round < 2; round++) {
+        int found = planner.sample(size);
+        if (found <= 1) {
+            printf("planner round %d: %d candidates, nothing to split at %lu ms\n",
+                round, found, timestamp() - started_);
+            break;
         }
-        else if (ops == "xor") op = XOR;
-        else if (ops == "and") op = AND;
-        else if (ops == "plus") op = PLUS;
-        else if (ops == "or") op = OR;
-        else if (ops == "not") op = NOT;
-        else if (ops == "shl1") op = SHL1;
-        else if (ops == "shr1") op = SHR1;
-        else if (ops == "shr4") op = SHR4;
-        else if (ops == "shr16") op = SHR16;
-        else if (ops == "fold") op = FOLD;
-        else if (ops == "if0") op = IF0;
-        else if (ops == "bonus") {
-            g.mode_bonus_ = true;
-            continue;
-         //   g.allow_all();
-         //   break;
-        } else {
-            fprintf(stderr, "Unknow op %s in allowed ops... allowing all\n", ops.c_str());
-            exit(1);
+        std::vector<Val> next;
+        planner.plan(64, &next);
+        if (next.empty() || !eval(id, &next[0], next.size(), outp))
+            break;
+        for (int i = 0; i < next.size(); i++) {
+            solver.add(next[i], outp[i]);
+            g.add_output(outp[i]);
         }
-        g.add_allowed_op(op);
+        printf("planner round %d: %d candidates, %d more inputs at %lu ms\n",
+            round, found, (int)next.size(), timestamp() - started_);
+        // every candidate was sampled and told apart, so another round
+        // finds one at most.
+        if (planner.exhaustive())
+            break;
+    }
+    g.mode_goal_ = true;
+    g.mode_partition_ = true;
+    g.mode_best_first_ = true;
+    g.mode_mcmc_ = true;
+    g.mode_features_ = true;
+    g.mode_bitsynth_ = true;
+    Recognizer r;
+    r.set_callback(&solver);
+    r.allowed_ops_ = g.allowed_ops_;
+    r.set_tfold(g.mode_tfold_);
+    bool recognized = r.recognize(size);
+    if (!recognized) {
+        solver.flush();
+        recognized = solver.win_;
+    }
+    if (recognized) {
+        printf("recognized as %s at %lu ms\n", r.family_, timestamp() - started_);
+    } else {
+        printf("start generation at %lu ms\n", timestamp() - started_);
+        g.set_callback(&solver);
+        // held candidates found by the end of a run bring pairs for another.
+        while (!g.generate(size) && solver.flush())
+            printf("generation again at %lu ms\n", timestamp() - started_);
     }
-    //g.add_allowed_op(NOT);
-    printf("start generation at %lu ms\n", timestamp() - started_);
-    g.set_callback(&solver);
-    g.generate(size);
 
     printf("\t\t\t\t\t\t\tCHALLENGE done in %lu ms   %f ops/ms\n\n", timestamp() - started_, 1. * solver.cnt / (timestamp() - started_));
+    EventLog::timing(solver.win_ ? "CHALLENGE won" : "CHALLENGE lost", timestamp() - started_);
+    Telemetry::Totals after;
+    Telemetry::read(&after);
+    Telemetry::print_delta(before, after);
+    if (solver.win_) {
+        printf("solved with %d guesses, %d batches in %lu ms\n",
+            solver.guesses_, solver.batches_, timestamp() - started_);
+        cache_.add(solver.winner_);
+    }
 
     return solver.win_;
 }
 
-void Protocol::guess(const string& id, const string &program, Json::Value& result)
+bool Protocol::eval(const string& id, const Val* inputs, int n, Val* outputs)
+{
+    // outputs in the store cost nothing, the rest is asked for.
+    std::vector<int> missing;
+    std::vector<Val> arguments;
+    for (int i = 0; i < n; i++) {
+        if (!store_.output(id, inputs[i], &outputs[i])) {
+            missing.push_back(i);
+            arguments.push_back(inputs[i]);
+        }
+    }
+    if (missing.empty())
+        return true;
+
+    std::vector<Val> values(missing.size());
+    if (!post("eval", codec_.eval_request(id, &arguments[0], arguments.size())))
+        return false;
+    if (!Codec::parse_eval(response_.data(), response_.size(), &values[0], values.size()))
+        return false;
+
+    for (int i = 0; i < missing.size(); i++) {
+        int k = missing[i];
+        outputs[k] = values[i];
+        store_.add_eval(id, inputs[k], outputs[k]);
+        EventLog::eval(inputs[k], outputs[k]);
+    }
+    return true;
+}
+
+void Protocol::load_cache(const char* path)
+{
+    int n = cache_.load(path);
+    printf("cache: %d programs from %s\n", n, path);
+}
+
+void Protocol::load_library(const char* path)
+{
+    if (library_.open(path))
+        printf("library: %d programs up to size %d from %s\n", library_.count(), library_.max_size(), path);
+}
+
+void Protocol::load_model(const char* path)
+{
+    if (model_.load(path))
+        printf("model: %ld choices from %s\n", model_.samples_, path);
+}
+
+void Protocol::open_store(const char* path)
+{
+    long started = timestamp();
+    int n = store_.open(path);
+    printf("store: %d problems from %s in %lu ms\n", n, path, timestamp() - started);
+}
+
+void Protocol::learn_model(const char* path)
+{
+    std::vector<string> programs;
+    cache_.programs(&programs);
+    OrderModel model;
+    for (int i = 0; i < programs.size(); i++) {
+        ExprPool pool;
+        Parser parser;
+        Expr* e = parser.parse(programs[i], &pool);
+        if (e)
+            model.learn(e);
+    }
+    if (!model.save(path)) {
+        fprintf(stderr, "can't write %s\n", path);
+        return;
+    }
+    printf("model: %ld choices of %d programs into %s\n", model.samples_, (int)programs.size(), path);
+}
+
+void Protocol::import_log(const char* path)
+{
+    int n = cache_.import_log(path);
+    printf("cache: %d new programs from %s, %d in all\n", n, path, cache_.count());
+}
+
+void Protocol::guess(const string& id, const string &program, Codec::Guess* result)
 {
     printf("guess initiated at %lu ms\n", timestamp() - started_);
-    Json::Value request;
-    request["id"] = id;
-    request["program"] = program;
 
-    if (!send("guess", request, result)) {
+    if (!post("guess", codec_.guess_request(id, program)) ||
+            !Codec::parse_guess(response_.data(), response_.size(), result)) {
         fprintf(stderr, "failed guess\n");
         exit(1);
     }
 
     printf("guess done at %lu ms\n", timestamp() - started_);
-    printf("guess response:\n%s\n", result.toStyledString().c_str());
+    printf("guess response: %s\n", result->status.c_str());
+    EventLog::guess(program, result->status);
+
+    if (result->status == "win") {
+        Telemetry::add(Telemetry::GUESS_WIN);
+        store_.set_solved(id, program);
+    } else if (result->status == "mismatch") {
+        Telemetry::add(Telemetry::GUESS_MISMATCH);
+        if (result->num_values >= 2)
+            store_.add_mismatch(id, result->values[0], result->values[1]);
+    } else
+        Telemetry::add(Telemetry::GUESS_ERROR);
 }
 
 void Protocol::print_tasks()
 {
-    retrieve_my_tasks();
-
-    int sizes[1000];
-    int wins[1000];
-    int lost[1000];
-    memset(sizes, 0, sizeof(sizes));
-    memset(wins, 0, sizeof(wins));
-    memset(lost, 0, sizeof(lost));
-
-    for (int i = 0; i < my_tasks_.size(); i++) {
-        const Json::Value& item = my_tasks_[i];
-        unsigned size = item["size"].asUInt();
-        bool solved = item["solved"].asBool();
-        int time_left = item.get("timeLeft", Json::Value(-1)).asInt();
-        if (time_left == 0 && !solved)
-            lost[size]++;
+    if (!store_.count())
+        retrieve_my_tasks();
+
+    std::map<int, int> sizes;
+    std::map<int, int> wins;
+    std::map<int, int> lost;
+    store_.sizes(&sizes);
+
+    for (int i = 0; i < store_.count(); i++) {
+        const ProblemStore::Problem& item = store_.problem(i);
+        int time_left = item.time_left;
+        if (item.status() == ProblemStore::FAILED)
+            lost[item.size]++;
+        if (item.solved)
+            wins[item.size]++;
         string tl_str;
         char buffer[30];
         snprintf(buffer, sizeof(buffer), "%2d", time_left);
         if (time_left >= 0)
             tl_str = buffer;
-        Json::Value operators = item["operators"];
+        Json::Value operators = operators_of(item.ops);
         string ops_str;
         for (int j = 0; j < operators.size(); j++)
             ops_str += " " + operators[j].asString();
-        printf("%4i: %s %3u %10s %10s  [%2d]:%s\n", i, item["id"].asCString(), size,
-            solved ? "SOLVED" : "", tl_str.c_str(),
+        printf("%4i: %s %3u %10s %10s  [%2d]:%s\n", i, item.id.c_str(), item.size,
+            item.solved ? "SOLVED" : "", tl_str.c_str(),
             operators.size(), ops_str.c_str());
-        if (size < 1000) {
-            ++sizes[size];
-            if (solved)
-                ++wins[size];
-        }
     }
     printf("\n");
 
     int total_wins = 0;
     int total = 0;
-    for (int i = 3; i < 1000; i++) {
-        if (sizes[i] == 0)
-            continue;
+    for (std::map<int, int>::iterator it = sizes.begin(); it != sizes.end(); ++it) {
+        int i = it->first;
         printf("size %2d: %3d / %3d  (%d)\n", i, wins[i], sizes[i], lost[i]);
         total_wins += wins[i];
         total += sizes[i];
@@ -352,33 +711,41 @@ void Protocol::print_tasks()
 
 void Protocol::retrieve_my_tasks()
 {
-    Json::Value request;
-    if (!send("myproblems", request, my_tasks_)) {
+    std::vector<Codec::Problem> tasks;
+    if (!post("myproblems", "{}") || !Codec::parse_problems(response_.data(), response_.size(), &tasks)) {
         fprintf(stderr, "Requst failed\n");
         return;
     }
+
+    // only new problems and status changes reach the store's log.
+    for (int i = 0; i < tasks.size(); i++) {
+        const Codec::Problem& item = tasks[i];
+        store_.update(item.id, item.size, item.operators, item.solved, item.time_left);
+    }
 }
 
 void Protocol::solve_my_tasks(int up_to_size)
 {
+    // the store may be from an earlier run, problems it opened since ran out.
     retrieve_my_tasks();
 
     int count = 0;
     for (int size = up_to_size; size <= up_to_size; size++) {
         // find an unsolved task of appropriate size.
-        for (int i = 0; i < my_tasks_.size(); i++) {
-            Json::Value& item = my_tasks_[i];
-            if (item["size"].asInt() != size)
-                continue;
-            if (item["solved"].asBool())
+        std::vector<int> tasks;
+        store_.by_size(size, &tasks);
+        for (int i = 0; i < tasks.size(); i++) {
+            const ProblemStore::Problem& item = store_.problem(tasks[i]);
+            if (item.solved)
                 continue;
-            if (item["timeLeft"].isNumeric() && item["timeLeft"].asInt() == 0)
+            if (item.time_left == 0)
                 continue;
   //          if (item["operators"].size() > 7)
   //              continue;
             bool has_tfold = false;
-            for (int j = 0; j < item["operators"].size(); j++) {
-                if (item["operators"][j].asString() == "fold") {
+            Json::Value operators = operators_of(item.ops);
+            for (int j = 0; j < operators.size(); j++) {
+                if (operators[j].asString() == "fold") {
                     has_tfold = true;
                     break;
                 }
@@ -400,54 +767,145 @@ void Protocol::solve_my_tasks(int up_to_size)
 
             printf("\n################################ %d #################################\n", ++count);
 
-            bool win = challenge(item["id"].asString(), item["size"].asInt(), item["operators"]);
-            if (win)
-                item["solved"] = true;
+            challenge(item.id, item.size, operators);
         }
     }
 }
 
-bool Protocol::send(const char* command, const Json::Value& request, Json::Value& result)
+void Protocol::solve_groups(int size, int max_group)
 {
-    char url[1000];
-    snprintf(url, 1000, "http://icfpc2013.cloudapp.net/%s?auth=0451EUqILPkx1zWe7fD4BMiNzwHIjPGCkbKYFxI0vpsH1H", command);
+    retrieve_my_tasks();
 
-    string data_string = request.toStyledString();
+    // tasks never opened only, their clocks start with the evals below.
+    std::map<string, std::vector<int> > groups;
+    std::vector<int> tasks;
+    store_.by_size(size, &tasks);
+    for (int i = 0; i < tasks.size(); i++) {
+        const ProblemStore::Problem& item = store_.problem(tasks[i]);
+        if (item.status() == ProblemStore::OPEN)
+            groups[item.ops].push_back(tasks[i]);
+    }
 
-    stringstream stream;
-    stream_ = &stream;
+    std::vector<Val> inputs;
+    SolutionCache::probe_inputs(&inputs);
+    Val x = 0x9e3779b97f4a7c15ul;
+    while (inputs.size() < 64) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        inputs.push_back(x);
+    }
 
-    curl_easy_setopt(curl, CURLOPT_URL, url);    
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data_string.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, response);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30);
-    curl_easy_setopt(curl, CURLOPT_PROXY, "");
+    for (std::map<string, std::vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        std::vector<int>& tasks = it->second;
+        for (int first = 0; first < tasks.size(); first += max_group) {
+            int n = std::min((int)tasks.size() - first, max_group);
+            printf("\n################################ group of %d: %s #################################\n", n, it->first.c_str());
+            started_ = timestamp();
+
+            Generator g;
+            set_operators(operators_of(it->first), &g);
+            if (model_.samples_)
+                g.model_ = &model_;
+            MultiVerifier mv;
+            mv.set_inputs(inputs);
+            // the enumeration has to end in time for the first problem.
+            long deadline = started_ + 290 * 1000;
+            mv.set_deadline(deadline);
+            std::vector<Solver*> solvers;
+            std::vector<Val> outputs(inputs.size());
+            for (int k = 0; k < n; k++) {
+                string id = store_.problem(tasks[first + k]).id;
+                Solver* solver = new Solver(id, this);
+                solver->cnt = 0;
+                solver->set_deadline(deadline);
+                solvers.push_back(solver);
+                if (!eval(id, &inputs[0], inputs.size(), &outputs[0])) {
+                    fprintf(stderr, "eval failed for %s\n", id.c_str());
+                    continue;
+                }
+                for (int j = 0; j < inputs.size(); j++)
+                    solver->add(inputs[j], outputs[j]);
+                mv.add(solver, &outputs[0]);
+            }
 
-    // Perform the request, res will get the return code 
-    CURLcode res = curl_easy_perform(curl);
+            g.set_callback(&mv);
+            g.generate(size);
 
-    if (res != CURLE_OK) {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        return false;
+            int won = 0;
+            for (int k = 0; k < n; k++) {
+                if (solvers[k]->win_) {
+                    won++;
+                    cache_.add(solvers[k]->winner_);
+                }
+                delete solvers[k];
+            }
+            printf("group solved %d of %d in %lu ms, %ld candidates, %ld routed\n",
+                won, n, timestamp() - started_, mv.checked_, mv.routed_);
+        }
     }
+}
 
-    Json::Reader reader;
-    if (!reader.parse(stream, result)) {
-        fprintf(stderr, "Failed to parse Json\n");
-        printf("sleeping for 5 sec...\n");
-        sleep(5);
-        return send(command, request, result);
-    }
+bool Protocol::post(const char* command, const string& body)
+{
+    char url[1000];
+    snprintf(url, 1000, "%s/%s?auth=0451EUqILPkx1zWe7fD4BMiNzwHIjPGCkbKYFxI0vpsH1H", base_url_.c_str(), command);
+
+    // 429, 5xx, transport errors and cut off bodies are tried again with a
+    // growing pause, other 4xx mean the request itself is wrong.
+    int wait = 5;
+    for (int attempt = 0; ; attempt++) {
+        if (attempt) {
+            if (attempt == 8) {
+                fprintf(stderr, "%s: giving up after %d attempts\n", command, attempt);
+                return false;
+            }
+            printf("sleeping for %d sec...\n", wait);
+            sleep(wait);
+            wait = std::min(wait * 2, 30);
+        }
 
-    return true;
+        response_.clear();
+
+        curl_easy_setopt(curl, CURLOPT_URL, url);    
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body.size());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, response);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30);
+        curl_easy_setopt(curl, CURLOPT_PROXY, "");
+
+        // Perform the request, res will get the return code 
+        CURLcode res = curl_easy_perform(curl);
+
+        if (res != CURLE_OK) {
+            fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+            continue;
+        }
+
+        long code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code == 429 || code >= 500) {
+            fprintf(stderr, "%s: http %ld\n", command, code);
+            continue;
+        }
+        if (code >= 400) {
+            fprintf(stderr, "%s: http %ld %s\n", command, code, response_.c_str());
+            return false;
+        }
+
+        // every answer is a json object or array, anything else got cut off.
+        size_t last = response_.find_last_not_of(" \t\r\n");
+        if (last == string::npos || (response_[last] != '}' && response_[last] != ']')) {
+            fprintf(stderr, "Failed to parse Json\n");
+            continue;
+        }
+        return true;
+    }
 }
 
 size_t Protocol::response(void *ptr, size_t size, size_t nmemb, void *user_data)
 {
-    Json::Reader reader;
-    Json::Value root;
-
     const char* buffer = (const char*)ptr;
     size_t len = size * nmemb;
 
@@ -459,7 +917,7 @@ size_t Protocol::response(void *ptr, size_t size, size_t nmemb, void *user_data)
 
 void Protocol::get_data(const char* data, size_t len)
 {
-    stream_->write(data, len);
+    response_.append(data, len);
 }
 
 int main(int argc, char* argv[])
@@ -469,11 +927,45 @@ int main(int argc, char* argv[])
     if (argc < 2)
         return 1;
 
+    // e.g. API=http://localhost:8013 for a mock.cc server.
+    if (getenv("API"))
+        p.set_base_url(getenv("API"));
+    // e.g. RULES=-commute,-de_morgan to switch rewrite rules off.
+    if (getenv("RULES") && !Rules::configure(getenv("RULES")))
+        return 1;
+
+    // e.g. CACHE=solutions.txt, appended to with every program won or seen.
+    p.load_cache(getenv("CACHE") ? getenv("CACHE") : "solutions.txt");
+    // e.g. LIBRARY=programs.lib, built by library.cc with -DLIBMAIN.
+    p.load_library(getenv("LIBRARY") ? getenv("LIBRARY") : "programs.lib");
+    // e.g. MODEL=model.txt, written by learn_model.
+    const char* model = getenv("MODEL") ? getenv("MODEL") : "model.txt";
+    p.load_model(model);
+    // e.g. STORE=problems.log, every problem, pair and outcome so far.
+    p.open_store(getenv("STORE") ? getenv("STORE") : "problems.log");
+    // e.g. EVENTS=events.bin, the trace; eventlog.cc with -DEVENTMAIN prints it.
+    const char* events = getenv("EVENTS") ? getenv("EVENTS") : "events.bin";
+    if (!EventLog::open(events))
+        fprintf(stderr, "can't write events to %s\n", events);
+    // e.g. TELEMETRY=telemetry.jsonl, a counter snapshot every second; a fifo works too.
+    if (getenv("TELEMETRY") && !Telemetry::start(getenv("TELEMETRY"), 1000))
+        fprintf(stderr, "can't write telemetry to %s\n", getenv("TELEMETRY"));
+
     string arg = argv[1];
     if (arg == "print")
         p.print_tasks();
+    else if (arg == "refresh") {
+        p.retrieve_my_tasks();
+        p.print_tasks();
+    }
     else if (arg == "solve_my" && argc > 2)
         p.solve_my_tasks(atoi(argv[2]));
+    else if (arg == "solve_groups" && argc > 2)
+        p.solve_groups(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 8);
+    else if (arg == "learn_model")
+        p.learn_model(model);
+    else if (arg == "import" && argc > 2)
+        p.import_log(argv[2]);
     else if (arg == "train" && argc > 2)
         p.train(atoi(argv[2]));
     else if (arg == "chal" && argc > 3) {
@@ -483,6 +975,10 @@ int main(int argc, char* argv[])
         p.challenge(argv[2], atoi(argv[3]), allowed);
     }
 
+    Telemetry::stop();
+    EventLog::close();
+    if (EventLog::dropped())
+        printf("events: %ld dropped\n", EventLog::dropped());
     return 0;
 }
 
@@ -0,0 +1,112 @@
+#include "recognizer.h"
+#include "mitm.h"
+
+#include <stdio.h>
+#include <vector>
+
+Recognizer::Recognizer()
+{
+	verifier_ = NULL;
+	offered_ = 0;
+	family_ = NULL;
+	tfold_ = false;
+}
+
+bool Recognizer::recognize(int size)
+{
+	// a tfold program has no x0 outside of the fold.
+	if (!tfold_ && chains(size))
+		return true;
+	if ((tfold_ || allowed_ops_.has(FOLD)) && folds(size))
+		return true;
+	return false;
+}
+
+bool Recognizer::offer(Expr* e, int size, const char* family)
+{
+	if (ExprPool::size(e) + 1 > size)
+		return false;
+	const Verifier::Pairs& pairs = verifier_->get_pairs();
+	for (Verifier::Pairs::const_iterator it = pairs.begin(); it != pairs.end(); ++it)
+		if (e->run(it->first) != it->second)
+			return false;
+	offered_++;
+	family_ = family;
+	return !verifier_->action(e, ExprPool::size(e) + 1);
+}
+
+bool Recognizer::chains(int size)
+{
+	static const Op unary[] = { NOT, SHL1, SHR1, SHR4, SHR16 };
+	static const Op binary[] = { AND, OR, XOR, PLUS };
+
+	// offer checks the pairs left out.
+	std::vector<Val> inputs, outputs;
+	Bank::pick_pairs(verifier_->get_pairs(), &inputs, &outputs);
+
+	// unary chains over x0, 0 and 1: shifted or negated copies of the
+	// input, and the constants a mask can be made of.
+	bank_.allowed_ops_ = OpSet();
+	for (int k = 0; k < sizeof(unary) / sizeof(*unary); k++)
+		if (allowed_ops_.has(unary[k]))
+			bank_.add_allowed_op(unary[k]);
+	bank_.set_inputs(inputs);
+	bank_.set_deadline(verifier_->deadline());
+	bank_.grow(size - 1);
+
+	int t = bank_.find(&outputs[0]);
+	if (t >= 0 && offer(bank_.build(t, &pool_), size, "shift chain"))
+		return true;
+
+	// (op chain chain), op with a constant included.
+	MitmSolver mitm(&bank_);
+	for (int k = 0; k < sizeof(binary) / sizeof(*binary); k++)
+		if (allowed_ops_.has(binary[k]))
+			mitm.add_allowed_op(binary[k]);
+	Expr* e = mitm.solve(&outputs[0], size - 1, &pool_);
+	return e && offer(e, size, "chain op chain");
+}
+
+bool Recognizer::folds(int size)
+{
+	static const Op unary[] = { NOT, SHL1, SHR1, SHR4, SHR16 };
+	static const Op binary[] = { PLUS, XOR, OR, AND };
+
+	// lambda operands: the byte, the accumulator, 1, x0 outside of tfold,
+	// and one unary op over the first two.
+	std::vector<Expr*> leaves;
+	leaves.push_back(pool_.var(1));
+	leaves.push_back(pool_.var(2));
+	leaves.push_back(pool_.make(C1));
+	if (!tfold_)
+		leaves.push_back(pool_.var(0));
+	for (int k = 0; k < sizeof(unary) / sizeof(*unary); k++) {
+		if (!allowed_ops_.has(unary[k]))
+			continue;
+		leaves.push_back(pool_.make(unary[k], pool_.var(1)));
+		leaves.push_back(pool_.make(unary[k], pool_.var(2)));
+	}
+
+	std::vector<Expr*> bodies(leaves);
+	for (int k = 0; k < sizeof(binary) / sizeof(*binary); k++) {
+		if (!allowed_ops_.has(binary[k]))
+			continue;
+		// all of them commute
+		for (int a = 0; a < (int)leaves.size(); a++)
+			for (int b = a; b < (int)leaves.size(); b++)
+				bodies.push_back(pool_.make(binary[k], leaves[a], leaves[b]));
+	}
+
+	// tfold starts from 0, a fold may also start from 1 or x0.
+	Op inits[] = { C0, C1, VAR };
+	int num_inits = tfold_ ? 1 : 3;
+	for (int i = 0; i < num_inits; i++) {
+		for (int b = 0; b < (int)bodies.size(); b++) {
+			Expr* init = inits[i] == VAR ? pool_.var(0) : pool_.make(inits[i]);
+			Expr* e = pool_.make(FOLD, pool_.var(0), init, bodies[b]);
+			if (offer(e, size, tfold_ ? "tfold reduction" : "byte fold"))
+				return true;
+		}
+	}
+	return false;
+}
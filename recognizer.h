@@ -0,0 +1,40 @@
+#ifndef RECOGNIZER_H
+#define RECOGNIZER_H
+
+#include "gen2.h"
+#include "bank.h"
+
+// Matches the pairs against a few program families before any search:
+// shift/not chains of the input, such a chain combined with another one or
+// with a constant (masks, bit extraction, input plus constant), and folds
+// whose lambda is at most one op over the byte and the accumulator, which
+// covers the usual tfold reductions. Each family is a single cheap pass.
+class Recognizer
+{
+public:
+	Recognizer();
+
+	void set_callback(Verifier* v) { verifier_ = v; }
+	void add_allowed_op(Op op) { allowed_ops_.add(op); }
+	void set_tfold(bool tfold) { tfold_ = tfold; }
+
+	// true if the callback asked to stop.
+	bool recognize(int size);
+
+	OpSet allowed_ops_;
+	int offered_;
+	const char* family_; // of the last program offered
+
+private:
+	bool chains(int size);
+	bool folds(int size);
+	// true if the callback asked to stop.
+	bool offer(Expr* e, int size, const char* family);
+
+	Verifier* verifier_;
+	ExprPool pool_;
+	Bank bank_;
+	bool tfold_;
+};
+
+#endif
@@ -0,0 +1,455 @@
+#include "replay.h"
+#include "bank.h"
+#include "codec.h"
+#include "parser.h"
+#include "recognizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sstream>
+
+static long now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000l + tv.tv_usec / 1000;
+}
+
+// the hex values in quotes on a line, e.g. of a JSON array.
+static void quoted_hex(const char* line, std::vector<Val>* values)
+{
+	for (const char* p = strstr(line, "\"0x"); p; p = strstr(p, "\"0x")) {
+		const char* end = strchr(p + 1, '"');
+		if (!end)
+			return;
+		Val v;
+		if (Codec::parse_hex(p + 1, end - p - 1, &v))
+			values->push_back(v);
+		p = end + 1;
+	}
+}
+
+// "  0101... -> 1100..." as the event log decoder prints an eval.
+static bool bit_pair(const char* line, Val* in, Val* out)
+{
+	while (*line == ' ')
+		line++;
+	if (strlen(line) < 64 + 4 + 64 || strncmp(line + 64, " -> ", 4))
+		return false;
+	*in = *out = 0;
+	for (int i = 0; i < 64; i++) {
+		if ((line[i] != '0' && line[i] != '1') || (line[68 + i] != '0' && line[68 + i] != '1'))
+			return false;
+		*in = *in << 1 | (line[i] - '0');
+		*out = *out << 1 | (line[68 + i] - '0');
+	}
+	return true;
+}
+
+// "[ "if0", "plus" ]" or "if0 plus" as space separated names.
+static string op_names(const char* text)
+{
+	string ops, name;
+	for (const char* p = text; ; p++) {
+		if (*p >= 'a' && *p <= 'z' || *p >= '0' && *p <= '9')
+			name += *p;
+		else if (!name.empty()) {
+			ops += (ops.empty() ? "" : " ") + name;
+			name.clear();
+		}
+		if (!*p || *p == '\n')
+			break;
+	}
+	return ops;
+}
+
+int Corpus::extract(const char* log)
+{
+	FILE* f = fopen(log, "r");
+	if (!f)
+		return 0;
+
+	// arguments and outputs come in arrays over many lines.
+	enum { NONE, ARGUMENTS, OUTPUTS } array = NONE;
+	std::vector<Val> arguments, outputs;
+	Recorded* r = NULL;
+	int first = records_.size();
+	string last;
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+		const char* accepted = strstr(line, "Challenge ACCEPTED");
+		if (accepted) {
+			records_.push_back(Recorded());
+			r = &records_.back();
+			r->size = 0;
+			last.clear();
+			array = NONE;
+			arguments.clear();
+			// "Challenge ACCEPTED: id size 13: if0 plus" in later logs.
+			char id[64];
+			int size;
+			const char* colon = strchr(accepted, ':');
+			if (colon && sscanf(colon + 1, " %63s size %d:", id, &size) == 2) {
+				r->id = id;
+				r->size = size;
+				r->operators = op_names(strchr(strstr(colon, " size "), ':') + 1);
+			}
+			continue;
+		}
+		if (!r)
+			continue;
+
+		Val in, out;
+		const char* lambda = strstr(line, "(lambda");
+		if (!strncmp(line, "id: ", 4)) {
+			r->id = line + 4;
+			r->id.erase(r->id.find_last_not_of(" \r\n") + 1);
+		} else if (!strncmp(line, "size: ", 6))
+			r->size = atoi(line + 6);
+		else if (!strncmp(line, "operators: ", 11))
+			r->operators = op_names(line + 11);
+		else if (strstr(line, "\"arguments\"")) {
+			array = ARGUMENTS;
+			arguments.clear();
+		} else if (strstr(line, "\"outputs\"")) {
+			array = OUTPUTS;
+			outputs.clear();
+		} else if (strstr(line, "\"values\"")) {
+			// a mismatch: input, the secret's output and ours.
+			std::vector<Val> values;
+			quoted_hex(line, &values);
+			if (values.size() == 3)
+				r->pairs.push_back(std::make_pair(values[0], values[1]));
+		} else if (array != NONE && strchr(line, ']')) {
+			if (array == OUTPUTS) {
+				for (int i = 0; i < outputs.size() && i < arguments.size(); i++)
+					r->pairs.push_back(std::make_pair(arguments[i], outputs[i]));
+				arguments.clear();
+			}
+			array = NONE;
+		} else if (array != NONE)
+			quoted_hex(line, array == ARGUMENTS ? &arguments : &outputs);
+		else if (bit_pair(line, &in, &out))
+			r->pairs.push_back(std::make_pair(in, out));
+		else if (lambda) {
+			last = lambda;
+			last.erase(last.find_last_of(')') + 1);
+		} else if ((strstr(line, "\"status\" : \"win\"") || strstr(line, "\"status\":\"win\"")) && !last.empty())
+			r->program = last;
+	}
+	fclose(f);
+
+	// a log cut off at the front starts in the middle of a challenge.
+	int n = 0;
+	for (int i = first; i < records_.size(); i++)
+		if (records_[i].size && !records_[i].pairs.empty())
+			records_[first + n++] = records_[i];
+	records_.resize(first + n);
+	return n;
+}
+
+int Corpus::load(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return 0;
+	char line[4096];
+	int n = 0;
+	Recorded* r = NULL;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == 'C') {
+			char id[64], ops[256];
+			records_.push_back(Recorded());
+			r = &records_.back();
+			r->size = 0;
+			int at = 0;
+			if (sscanf(line, "C %63s %d %255s %n", id, &r->size, ops, &at) < 3)
+				continue;
+			r->id = id;
+			r->operators = strcmp(ops, "-") ? ops : "";
+			for (int i = 0; i < r->operators.size(); i++)
+				if (r->operators[i] == ',')
+					r->operators[i] = ' ';
+			if (at && line[at] == '(') {
+				r->program = line + at;
+				r->program.erase(r->program.find_last_of(')') + 1);
+			}
+			n++;
+		} else if (line[0] == 'E' && r) {
+			char in[32], out[32];
+			Val a, b;
+			if (sscanf(line, "E %31s %31s", in, out) == 2 &&
+					Codec::parse_hex(in, strlen(in), &a) && Codec::parse_hex(out, strlen(out), &b))
+				r->pairs.push_back(std::make_pair(a, b));
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+bool Corpus::save(const char* path) const
+{
+	FILE* f = fopen(path, "w");
+	if (!f)
+		return false;
+	for (int i = 0; i < records_.size(); i++) {
+		const Recorded& r = records_[i];
+		string ops = r.operators;
+		for (int k = 0; k < ops.size(); k++)
+			if (ops[k] == ' ')
+				ops[k] = ',';
+		fprintf(f, "C %s %d %s %s\n", r.id.c_str(), r.size, ops.empty() ? "-" : ops.c_str(), r.program.c_str());
+		char in[19], out[19];
+		in[18] = out[18] = 0;
+		for (int k = 0; k < r.pairs.size(); k++) {
+			Codec::put_hex(r.pairs[k].first, in);
+			Codec::put_hex(r.pairs[k].second, out);
+			fprintf(f, "E %s %s\n", in, out);
+		}
+	}
+	return fclose(f) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+// answers guesses from the recorded winner, or takes the first candidate
+// when there is none.
+class Offline : public Verifier
+{
+public:
+	Offline(Expr* secret, long deadline, Replay::Stats* stats, long started)
+		: secret_(secret), stats_(stats), started_(started)
+	{
+		set_deadline(deadline);
+		Val x = 0x2545f4914f6cdd1dul;
+		for (int i = 0; i < 64; i++)
+			checks_.push_back(1ul << i);
+		checks_.push_back(0);
+		checks_.push_back(~0ul);
+		while (checks_.size() < 1024) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			checks_.push_back(checks_.size() % 2 ? x : x & 0xff);
+		}
+	}
+
+	virtual bool action(Expr* e, int size)
+	{
+		if (++stats_->programs % 4096 == 0 && !poll())
+			return false;
+		for (Pairs::iterator it = pairs.begin(); it != pairs.end(); ++it)
+			if (e->run(it->first) != it->second)
+				return true;
+
+		if (stats_->first_ms < 0)
+			stats_->first_ms = now_ms() - started_;
+		stats_->candidates++;
+		if (secret_) {
+			for (int i = 0; i < checks_.size(); i++) {
+				Val expected = secret_->run(checks_[i]);
+				if (e->run(checks_[i]) != expected) {
+					stats_->false_candidates++;
+					add(checks_[i], expected);
+					return true;
+				}
+			}
+		}
+		stats_->solved = true;
+		stats_->verified = secret_ != NULL;
+		return false;
+	}
+
+private:
+	Expr* secret_;
+	Replay::Stats* stats_;
+	long started_;
+	std::vector<Val> checks_;
+};
+
+Replay::Stats Replay::run(const Recorded& r)
+{
+	Stats stats;
+	stats.first_ms = -1;
+	stats.programs = 0;
+	stats.candidates = 0;
+	stats.false_candidates = 0;
+	stats.solved = false;
+	stats.verified = false;
+
+	ExprPool pool;
+	Parser parser;
+	Expr* secret = r.program.empty() ? NULL : parser.parse(r.program, &pool);
+
+	long started = now_ms();
+	Offline offline(secret, started + budget_ms_, &stats, started);
+	Generator g;
+	for (int i = 0; i < r.pairs.size(); i++) {
+		offline.add(r.pairs[i].first, r.pairs[i].second);
+		g.add_output(r.pairs[i].second);
+	}
+
+	std::stringstream stream(r.operators);
+	string name;
+	while (stream >> name) {
+		if (name == "tfold")
+			g.mode_tfold_ = true;
+		else if (name == "bonus")
+			g.mode_bonus_ = true;
+		else if (Parser::op(name) != DUMMY_OP)
+			g.add_allowed_op(Parser::op(name));
+	}
+
+	// the same stages as a live challenge after its evals.
+	g.mode_goal_ = true;
+	g.mode_partition_ = true;
+	g.mode_best_first_ = true;
+	g.mode_mcmc_ = true;
+	g.mode_features_ = true;
+	g.mode_bitsynth_ = true;
+	Recognizer recognizer;
+	recognizer.set_callback(&offline);
+	recognizer.allowed_ops_ = g.allowed_ops_;
+	recognizer.set_tfold(g.mode_tfold_);
+	if (!recognizer.recognize(r.size) && !stats.solved) {
+		g.set_callback(&offline);
+		g.generate(r.size);
+	}
+
+	stats.total_ms = now_ms() - started;
+	return stats;
+}
+
+#ifdef REPLAYMAIN
+
+// Benchmark over recorded challenges, e.g.
+//     replay extract corpus.txt 13.log more.log
+//     replay run corpus.txt stats.json [max_size] [seconds per challenge]
+// The JSON has a record per challenge and totals per size and op set, to
+// be compared between builds.
+
+#include <algorithm>
+#include <map>
+
+struct Totals
+{
+	Totals() : runs(0), solved(0), with_first(0), first_ms(0), total_ms(0), programs(0), false_candidates(0) {}
+
+	void add(const Replay::Stats& s)
+	{
+		runs++;
+		solved += s.solved;
+		if (s.first_ms >= 0) {
+			with_first++;
+			first_ms += s.first_ms;
+		}
+		total_ms += s.total_ms;
+		programs += s.programs;
+		false_candidates += s.false_candidates;
+		times.push_back(s.total_ms);
+	}
+
+	void print(FILE* f)
+	{
+		std::sort(times.begin(), times.end());
+		fprintf(f, "{\"runs\": %d, \"solved\": %d, \"mean_first_candidate_ms\": %.1f, "
+			"\"median_total_ms\": %ld, \"total_ms\": %ld, \"programs_per_s\": %.0f, \"false_candidates\": %d}",
+			runs, solved, with_first ? 1. * first_ms / with_first : -1.,
+			times.empty() ? 0 : times[times.size() / 2], total_ms,
+			total_ms ? 1000. * programs / total_ms : 0., false_candidates);
+	}
+
+	int runs;
+	int solved;
+	int with_first;
+	long first_ms;
+	long total_ms;
+	long programs;
+	int false_candidates;
+	std::vector<long> times;
+};
+
+static void print_totals(FILE* f, const char* name, std::map<string, Totals>& totals, bool last)
+{
+	fprintf(f, "  \"%s\": {\n", name);
+	for (std::map<string, Totals>::iterator it = totals.begin(); it != totals.end(); ++it) {
+		fprintf(f, "    \"%s\": ", it->first.c_str());
+		it->second.print(f);
+		fprintf(f, "%s\n", it == --totals.end() ? "" : ",");
+	}
+	fprintf(f, "  }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 3 && !strcmp(argv[1], "extract")) {
+		Corpus corpus;
+		for (int i = 3; i < argc; i++)
+			printf("%s: %d challenges\n", argv[i], corpus.extract(argv[i]));
+		if (!corpus.save(argv[2])) {
+			perror(argv[2]);
+			return 1;
+		}
+		return 0;
+	}
+	if (argc < 4 || strcmp(argv[1], "run")) {
+		fprintf(stderr, "usage: %s extract corpus.txt log...\n"
+			"       %s run corpus.txt stats.json [max_size] [seconds]\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	Corpus corpus;
+	if (!corpus.load(argv[2])) {
+		fprintf(stderr, "no challenges in %s\n", argv[2]);
+		return 1;
+	}
+	int max_size = argc > 4 ? atoi(argv[4]) : 42;
+	Replay replay;
+	if (argc > 5)
+		replay.set_budget(atol(argv[5]) * 1000);
+
+	// the search prints as it goes, the numbers go to a file of their own.
+	FILE* f = fopen(argv[3], "w");
+	if (!f) {
+		perror(argv[3]);
+		return 1;
+	}
+	std::map<string, Totals> by_size, by_ops;
+	Totals all;
+	fprintf(f, "{\n  \"build\": \"%s %s\",\n  \"challenges\": [\n", __DATE__, __TIME__);
+	bool first = true;
+	for (int i = 0; i < corpus.records_.size(); i++) {
+		const Recorded& r = corpus.records_[i];
+		if (r.size > max_size)
+			continue;
+		Replay::Stats s = replay.run(r);
+		printf("replay %s size %d %s: %s in %ld ms, %d false candidates\n", r.id.c_str(), r.size,
+			r.operators.c_str(), s.solved ? "solved" : "unsolved", s.total_ms, s.false_candidates);
+		fflush(stdout);
+		fprintf(f, "%s    {\"id\": \"%s\", \"size\": %d, \"operators\": \"%s\", \"solved\": %s, \"verified\": %s, "
+			"\"first_candidate_ms\": %ld, \"total_ms\": %ld, \"programs\": %ld, \"candidates\": %d, \"false_candidates\": %d}",
+			first ? "" : ",\n", r.id.c_str(), r.size, r.operators.c_str(), s.solved ? "true" : "false",
+			s.verified ? "true" : "false", s.first_ms, s.total_ms, s.programs, s.candidates, s.false_candidates);
+		first = false;
+
+		char size[16];
+		snprintf(size, sizeof(size), "%d", r.size);
+		by_size[size].add(s);
+		by_ops[r.operators].add(s);
+		all.add(s);
+	}
+	fprintf(f, "\n  ],\n");
+	print_totals(f, "by_size", by_size, false);
+	print_totals(f, "by_ops", by_ops, false);
+	fprintf(f, "  \"all\": ");
+	all.print(f);
+	fprintf(f, "\n}\n");
+	fclose(f);
+	return 0;
+}
+
+#endif
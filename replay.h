@@ -0,0 +1,61 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "gen2.h"
+
+#include <vector>
+
+// A challenge the way a log recorded it: the pairs the server told us and
+// the program that won, if one did.
+struct Recorded
+{
+	string id;
+	int size;
+	string operators; // space separated
+	std::vector<std::pair<Val, Val> > pairs; // evals and mismatches
+	string program;
+};
+
+// Recorded challenges in a file of their own. Logs are text traces such as
+// 13.log or the output of eventlog.cc built with -DEVENTMAIN. The corpus
+// file has a line per challenge and one per pair,
+//     C id size ops program
+//     E in out
+// with ops comma separated and the program left out if none won.
+class Corpus
+{
+public:
+	// appends the challenges found in a log, returns how many.
+	int extract(const char* log);
+	int load(const char* path);
+	bool save(const char* path) const;
+
+	std::vector<Recorded> records_;
+};
+
+// Runs the search on a recorded challenge without a server: candidates
+// must agree with the recorded pairs and a guess is answered by running
+// the recorded winner, a mismatch adding its pair like the server's would.
+class Replay
+{
+public:
+	struct Stats {
+		long first_ms;  // to the first candidate, -1 if none
+		long total_ms;
+		long programs;  // offered to the verifier
+		int candidates; // agreeing with all pairs so far
+		int false_candidates;
+		bool solved;
+		bool verified;  // against a recorded winner
+	};
+
+	Replay() : budget_ms_(60000) {}
+
+	void set_budget(long ms) { budget_ms_ = ms; }
+	Stats run(const Recorded& r);
+
+private:
+	long budget_ms_;
+};
+
+#endif
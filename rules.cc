@@ -0,0 +1,199 @@
+#include "rules.h"
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define OPS1(a)          (1 << (a))
+#define OPS2(a, b)       (OPS1(a) | OPS1(b))
+#define OPS4(a, b, c, d) (OPS2(a, b) | OPS2(c, d))
+
+static bool same(Expr* a, Expr* b)
+{
+	return a->compare(b) == 0;
+}
+
+static bool const_01(Op op, Expr** args, OpSet allowed)
+{
+	int arity = Expr::arity(op);
+	for (int i = 0; i < arity; i++)
+		if (!args[i]->is_const())
+			return false;
+	Val v = Expr::apply(op, args[0]->val, arity > 1 ? args[1]->val : 0);
+	return v == 0 || v == 1;
+}
+
+static bool double_not(Op op, Expr** args, OpSet allowed)
+{
+	return args[0]->op == NOT;
+}
+
+static bool const_if0(Op op, Expr** args, OpSet allowed)
+{
+	return args[0]->is_const();
+}
+
+static bool if0_same(Op op, Expr** args, OpSet allowed)
+{
+	return same(args[1], args[2]);
+}
+
+static bool zero_opnd(Op op, Expr** args, OpSet allowed)
+{
+	return args[0]->is_const(0) || args[1]->is_const(0);
+}
+
+static bool ones_opnd(Op op, Expr** args, OpSet allowed)
+{
+	return args[0]->is_const(~0ul) || args[1]->is_const(~0ul);
+}
+
+static bool idempotent(Op op, Expr** args, OpSet allowed)
+{
+	return same(args[0], args[1]);
+}
+
+static bool plus_self(Op op, Expr** args, OpSet allowed)
+{
+	return allowed.has(SHL1) && same(args[0], args[1]);
+}
+
+static bool absorbs(Op inner, Expr* x, Expr* y)
+{
+	return y->op == inner && (same(x, y->opnd[0]) || same(x, y->opnd[1]));
+}
+
+static bool absorption(Op op, Expr** args, OpSet allowed)
+{
+	Op inner = op == AND ? OR : AND;
+	return absorbs(inner, args[0], args[1]) || absorbs(inner, args[1], args[0]);
+}
+
+static bool de_morgan(Op op, Expr** args, OpSet allowed)
+{
+	Op dual = op == AND ? OR : AND;
+	return allowed.has(dual) && args[0]->op == NOT && args[1]->op == NOT;
+}
+
+static bool xor_not(Op op, Expr** args, OpSet allowed)
+{
+	return args[0]->op == NOT || args[1]->op == NOT;
+}
+
+static bool commute(Op op, Expr** args, OpSet allowed)
+{
+	return args[0]->compare(args[1]) > 0;
+}
+
+static int shift_of(Op op)
+{
+	switch (op) {
+	case SHR1:  return 1;
+	case SHR4:  return 4;
+	case SHR16: return 16;
+	default:    return 0;
+	}
+}
+
+static bool shift_chain(Op op, Expr** args, OpSet allowed)
+{
+	// (shr1 (shr1 (shr1 (shr1 x)))) is (shr4 x), the same for shr4 and shr16.
+	Op wider = op == SHR1 ? SHR4 : op == SHR4 ? SHR16 : DUMMY_OP;
+	if (wider != DUMMY_OP && allowed.has(wider)) {
+		Expr* e = args[0];
+		int n = 1;
+		while (n < 4 && e->op == op) {
+			e = e->opnd[0];
+			n++;
+		}
+		if (n == 4)
+			return true;
+	}
+
+	// everything shifted out is just 0.
+	int total = shift_of(op);
+	for (Expr* e = args[0]; shift_of(e->op); e = e->opnd[0])
+		total += shift_of(e->op);
+	return total >= 64;
+}
+
+static bool shift_order(Op op, Expr** args, OpSet allowed)
+{
+	// keep narrower shifts outside: (shr1 (shr4 x)), never (shr4 (shr1 x)).
+	return shift_of(args[0]->op) && shift_of(args[0]->op) < shift_of(op);
+}
+
+Rule Rules::table_[MAX_RULE] = {
+	{ "const_01",     OPS4(NOT, SHL1, SHR1, SHR4) | OPS1(SHR16) | OPS4(AND, OR, XOR, PLUS),
+	                  const_01,    true },
+	{ "double_not",   OPS1(NOT),                   double_not,  true },
+	{ "const_if0",    OPS1(IF0),                   const_if0,   true },
+	{ "if0_same",     OPS1(IF0),                   if0_same,    true },
+	{ "zero_opnd",    OPS4(AND, OR, XOR, PLUS),    zero_opnd,   true },
+	{ "ones_opnd",    OPS2(AND, OR) | OPS1(XOR),   ones_opnd,   true },
+	{ "idempotent",   OPS2(AND, OR) | OPS1(XOR),   idempotent,  true },
+	{ "plus_self",    OPS1(PLUS),                  plus_self,   true },
+	{ "absorption",   OPS2(AND, OR),               absorption,  true },
+	{ "de_morgan",    OPS2(AND, OR),               de_morgan,   true },
+	{ "xor_not",      OPS1(XOR),                   xor_not,     true },
+	{ "commute",      OPS4(AND, OR, XOR, PLUS),    commute,     true },
+	{ "shift_chain",  OPS2(SHR1, SHR4) | OPS1(SHR16), shift_chain, true },
+	{ "shift_order",  OPS2(SHR4, SHR16),           shift_order, true },
+	{ "const_lambda", OPS1(FOLD),                  NULL,        true },
+};
+
+bool Rules::reject(Op op, Expr** args, OpSet allowed)
+{
+	for (int i = 0; i < MAX_RULE; i++) {
+		Rule& r = table_[i];
+		if (!(r.ops & (1 << op)) || !r.enabled || !r.match)
+			continue;
+		if (r.match(op, args, allowed)) {
+			Telemetry::add(Telemetry::RULE + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Rules::reject_lambda(Expr* lambda)
+{
+	Rule& r = table_[R_CONST_LAMBDA];
+	if (r.enabled && (lambda->is_const() || lambda->is_var(0))) {
+		Telemetry::add(Telemetry::RULE + R_CONST_LAMBDA);
+		return true;
+	}
+	return false;
+}
+
+bool Rules::configure(const char* spec)
+{
+	bool ok = true;
+	std::string s = spec;
+	size_t pos = 0;
+	while (pos <= s.size()) {
+		size_t end = s.find(',', pos);
+		if (end == std::string::npos)
+			end = s.size();
+		std::string name = s.substr(pos, end - pos);
+		pos = end + 1;
+		if (name.empty())
+			continue;
+		bool on = name[0] != '-';
+		if (!on)
+			name = name.substr(1);
+		bool found = false;
+		for (int i = 0; i < MAX_RULE; i++) {
+			if (name == "all" || name == table_[i].name) {
+				table_[i].enabled = on;
+				found = true;
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "unknown rule %s\n", name.c_str());
+			ok = false;
+		}
+	}
+	return ok;
+}
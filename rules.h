@@ -0,0 +1,52 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include "gen2.h"
+
+// Rewrite rules the enumerator consults before emitting an op. Each rule
+// describes a shape that has an equivalent program which is not bigger and
+// which is still enumerated, so rejecting the shape keeps the search complete.
+
+enum RuleId {
+	R_CONST_01,      // constant subexpression equal to 0 or 1
+	R_DOUBLE_NOT,    // (not (not x)) -> x
+	R_CONST_IF0,     // (if0 c a b) with constant c -> a or b
+	R_IF0_SAME,      // (if0 c x x) -> x
+	R_ZERO_OPND,     // (and x 0) -> 0, (or|xor|plus x 0) -> x
+	R_ONES_OPND,     // (and x ~0) -> x, (or x ~0) -> ~0, (xor x ~0) -> (not x)
+	R_IDEMPOTENT,    // (and x x) -> x, (or x x) -> x, (xor x x) -> 0
+	R_PLUS_SELF,     // (plus x x) -> (shl1 x)
+	R_ABSORPTION,    // (and x (or x y)) -> x, (or x (and x y)) -> x
+	R_DE_MORGAN,     // (and (not x) (not y)) -> (not (or x y)) and dual
+	R_XOR_NOT,       // (xor (not x) y) -> (not (xor x y))
+	R_COMMUTE,       // operands of commutative ops in canonical order
+	R_SHIFT_CHAIN,   // (shr1 (shr1 (shr1 (shr1 x)))) -> (shr4 x), shift out -> 0
+	R_SHIFT_ORDER,   // (shr4 (shr1 x)) -> (shr1 (shr4 x))
+	R_CONST_LAMBDA,  // fold lambda that ignores x1 and x2
+	MAX_RULE
+};
+
+struct Rule
+{
+	const char* name;
+	int ops; // mask of ops the rule is checked for
+	bool (*match)(Op op, Expr** args, OpSet allowed);
+	bool enabled;
+};
+
+class Rules
+{
+public:
+	// true if (op args...) is not canonical and should not be emitted.
+	static bool reject(Op op, Expr** args, OpSet allowed);
+	static bool reject_lambda(Expr* lambda);
+
+	static void enable(RuleId id, bool on) { table_[id].enabled = on; }
+	static bool enabled(RuleId id) { return table_[id].enabled; }
+	// spec is a comma separated list of rule names, "-name" disables a rule.
+	static bool configure(const char* spec);
+
+	static Rule table_[MAX_RULE];
+};
+
+#endif
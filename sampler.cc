@@ -0,0 +1,446 @@
+#include "sampler.h"
+#include "parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+
+enum { TOP, LAMBDA, WITH_FOLD };
+
+static const Op unary_ops[] = { NOT, SHL1, SHR1, SHR4, SHR16 };
+static const Op binary_ops[] = { AND, OR, XOR, PLUS };
+
+Sampler::Sampler(uint64_t seed)
+{
+	max_tries_ = 1000000;
+	state_ = seed;
+	fold_ = tfold_ = bonus_ = false;
+	table_max_ = 0;
+}
+
+// splitmix64, so that nearby seeds still give unrelated streams.
+uint64_t Sampler::next()
+{
+	uint64_t z = (state_ += 0x9e3779b97f4a7c15ul);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+	return z ^ (z >> 31);
+}
+
+Sampler::Count Sampler::below(Count n)
+{
+	// drop the top partial range, which would favour small values.
+	Count limit = ~(Count)0 - (~(Count)0 % n);
+	Count r;
+	do
+		r = ((Count)next() << 64) | next();
+	while (r >= limit);
+	return r % n;
+}
+
+bool Sampler::set_operators(const string& ops)
+{
+	listed_ = OpSet();
+	fold_ = tfold_ = bonus_ = false;
+	table_max_ = 0;
+	std::stringstream stream(ops);
+	string name;
+	while (stream >> name) {
+		if (name == "tfold")
+			tfold_ = true;
+		else if (name == "bonus")
+			bonus_ = true;
+		else if (name == "fold")
+			fold_ = true;
+		else if (Parser::op(name) != DUMMY_OP)
+			listed_.add(Parser::op(name));
+		else
+			return false;
+	}
+	return true;
+}
+
+void Sampler::tabulate(OpSet ops, int max, Table* t) const
+{
+	int unary = 0, binary = 0;
+	for (int i = 0; i < sizeof(unary_ops) / sizeof(*unary_ops); i++)
+		unary += ops.has(unary_ops[i]);
+	for (int i = 0; i < sizeof(binary_ops) / sizeof(*binary_ops); i++)
+		binary += ops.has(binary_ops[i]);
+	bool if0 = ops.has(IF0);
+
+	t->top.assign(max + 1, 0);
+	t->lambda.assign(max + 1, 0);
+	t->fold.assign(max + 1, 0);
+	if (max < 1)
+		return;
+	t->top[1] = 3;    // 0, 1, x0
+	t->lambda[1] = 5; // and x1, x2
+	std::vector<Count>* kinds[] = { &t->top, &t->lambda };
+	for (int n = 2; n <= max; n++) {
+		for (int k = 0; k < 2; k++) {
+			std::vector<Count>& x = *kinds[k];
+			Count c = unary * x[n - 1];
+			for (int a = 1; a < n - 1; a++) {
+				c += binary * x[a] * x[n - 1 - a];
+				if (if0)
+					for (int b = 1; a + b < n - 1; b++)
+						c += x[a] * x[b] * x[n - 1 - a - b];
+			}
+			x[n] = c;
+		}
+
+		// the fold is in one of the operands, or this is it.
+		const std::vector<Count>& top = t->top;
+		const std::vector<Count>& fold = t->fold;
+		Count c = unary * fold[n - 1];
+		for (int a = 1; a < n - 1; a++) {
+			int b = n - 1 - a;
+			c += binary * (fold[a] * top[b] + top[a] * fold[b]);
+			if (if0)
+				for (b = 1; a + b < n - 1; b++) {
+					int r = n - 1 - a - b;
+					c += fold[a] * top[b] * top[r] + top[a] * fold[b] * top[r] + top[a] * top[b] * fold[r];
+				}
+		}
+		if (fold_)
+			for (int a = 1; a < n - 2; a++)
+				for (int b = 1; a + b < n - 2; b++)
+					c += top[a] * top[b] * t->lambda[n - 2 - a - b];
+		t->fold[n] = c;
+	}
+}
+
+Sampler::Count Sampler::shapes(const Table& t, int size) const
+{
+	if (tfold_)
+		return size > 5 ? t.lambda[size - 5] : 0;
+	if (bonus_) {
+		// (if0 (and 1 e) e e), with no fold anywhere.
+		Count c = 0;
+		int n = size - 4;
+		for (int a = 1; a < n; a++)
+			for (int b = 1; a + b < n; b++)
+				c += t.top[a] * t.top[b] * t.top[n - a - b];
+		return c;
+	}
+	if (size < 2)
+		return 0;
+	return fold_ ? t.fold[size - 1] : t.top[size - 1];
+}
+
+Sampler::Count Sampler::count(int size)
+{
+	if (size < 2)
+		return 0;
+	// the shape itself takes care of some of the listed ops.
+	OpSet required = listed_;
+	if (bonus_) {
+		required.del(AND);
+		required.del(IF0);
+	}
+	std::vector<Op> optional;
+	for (int op = FIRST_OP; op < MAX_OP; op++)
+		if (required.has((Op)op))
+			optional.push_back((Op)op);
+
+	// wraps around past 2^128, which cancels out as long as the result fits.
+	Count total = 0;
+	Table t;
+	for (int mask = 0; mask < 1 << optional.size(); mask++) {
+		OpSet ops = listed_;
+		int left_out = 0;
+		for (int i = 0; i < optional.size(); i++)
+			if (mask & (1 << i)) {
+				ops.del(optional[i]);
+				left_out++;
+			}
+		tabulate(ops, size, &t);
+		Count c = shapes(t, size);
+		total = left_out % 2 ? total - c : total + c;
+	}
+	return total;
+}
+
+int Sampler::min_size(int max)
+{
+	for (int size = 2; size <= max; size++)
+		if (count(size))
+			return size;
+	return 0;
+}
+
+Expr* Sampler::term(int kind, int size, ExprPool* pool)
+{
+	if (size == 1) {
+		int leaf = below(kind == LAMBDA ? 5 : 3);
+		return leaf == 0 ? pool->make(C0) : leaf == 1 ? pool->make(C1) : pool->var(leaf - 2);
+	}
+
+	const std::vector<Count>& top = table_.top;
+	const std::vector<Count>& fold = table_.fold;
+	const std::vector<Count>& x = kind == LAMBDA ? table_.lambda : top;
+	Count r = below(kind == WITH_FOLD ? fold[size] : x[size]);
+
+	// every choice below takes a share of [0, count) as big as the number
+	// of terms it leads to.
+	for (int i = 0; i < sizeof(unary_ops) / sizeof(*unary_ops); i++) {
+		if (!listed_.has(unary_ops[i]))
+			continue;
+		Count c = kind == WITH_FOLD ? fold[size - 1] : x[size - 1];
+		if (r < c)
+			return pool->make(unary_ops[i], term(kind, size - 1, pool));
+		r -= c;
+	}
+	int n = size - 1;
+	for (int a = 1; a < n; a++) {
+		int b = n - a;
+		for (int i = 0; i < sizeof(binary_ops) / sizeof(*binary_ops); i++) {
+			if (!listed_.has(binary_ops[i]))
+				continue;
+			if (kind != WITH_FOLD) {
+				Count c = x[a] * x[b];
+				if (r < c)
+					return pool->make(binary_ops[i], term(kind, a, pool), term(kind, b, pool));
+				r -= c;
+				continue;
+			}
+			Count c = fold[a] * top[b];
+			if (r < c)
+				return pool->make(binary_ops[i], term(WITH_FOLD, a, pool), term(TOP, b, pool));
+			r -= c;
+			c = top[a] * fold[b];
+			if (r < c)
+				return pool->make(binary_ops[i], term(TOP, a, pool), term(WITH_FOLD, b, pool));
+			r -= c;
+		}
+		if (!listed_.has(IF0))
+			continue;
+		for (b = 1; a + b < n; b++) {
+			int parts[3] = { a, b, n - a - b };
+			// which of the three holds the fold, if any.
+			for (int f = 0; f < (kind == WITH_FOLD ? 3 : 1); f++) {
+				Count c = 1;
+				for (int k = 0; k < 3; k++)
+					c *= kind != WITH_FOLD ? x[parts[k]] : k == f ? fold[parts[k]] : top[parts[k]];
+				if (r < c) {
+					Expr* e[3];
+					for (int k = 0; k < 3; k++)
+						e[k] = term(kind != WITH_FOLD ? kind : k == f ? WITH_FOLD : TOP, parts[k], pool);
+					return pool->make(IF0, e[0], e[1], e[2]);
+				}
+				r -= c;
+			}
+		}
+	}
+
+	// what is left is the fold itself.
+	for (int a = 1; a < size - 2; a++)
+		for (int b = 1; a + b < size - 2; b++) {
+			int l = size - 2 - a - b;
+			Count c = top[a] * top[b] * table_.lambda[l];
+			if (r < c)
+				return pool->make(FOLD, term(TOP, a, pool), term(TOP, b, pool), term(LAMBDA, l, pool));
+			r -= c;
+		}
+	return NULL;
+}
+
+static void collect_ops(Expr* e, OpSet* ops)
+{
+	ops->add(e->op);
+	for (int i = 0; i < e->arity(); i++)
+		collect_ops(e->opnd[i], ops);
+}
+
+Expr* Sampler::sample(int size, ExprPool* pool)
+{
+	if (table_max_ < size) {
+		tabulate(listed_, size, &table_);
+		table_max_ = size;
+	}
+	Count total = shapes(table_, size);
+	if (!total)
+		return NULL;
+
+	for (int tries = 0; tries < max_tries_; tries++) {
+		Expr* e;
+		if (tfold_)
+			e = pool->make(FOLD, pool->var(0), pool->make(C0), term(LAMBDA, size - 5, pool));
+		else if (bonus_) {
+			int n = size - 4;
+			Count r = below(total);
+			e = NULL;
+			for (int a = 1; a < n && !e; a++)
+				for (int b = 1; a + b < n && !e; b++) {
+					Count c = table_.top[a] * table_.top[b] * table_.top[n - a - b];
+					if (r < c)
+						e = pool->make(IF0, pool->make(AND, pool->make(C1), term(TOP, n - a - b, pool)),
+							term(TOP, b, pool), term(TOP, a, pool));
+					else
+						r -= c;
+				}
+		} else
+			e = term(fold_ ? WITH_FOLD : TOP, size - 1, pool);
+
+		OpSet used;
+		collect_ops(e, &used);
+		if ((used.set_ & listed_.set_) == listed_.set_)
+			return e;
+	}
+	return NULL;
+}
+
+string Sampler::to_string(Count c)
+{
+	if (!c)
+		return "0";
+	char digits[48];
+	int n = 0;
+	while (c) {
+		digits[n++] = '0' + (int)(c % 10);
+		c /= 10;
+	}
+	string s;
+	while (n)
+		s += digits[--n];
+	return s;
+}
+
+#ifdef SAMPLEMAIN
+
+// Secrets for mock.cc and benchmarks, e.g.
+//     sampler count 12 fold if0 plus
+//     sampler draw 12 5 1 fold if0 plus
+//     sampler tasks tasks.txt secrets.txt [seed] [n]
+// tasks draws a program for every problem listed in tasks.txt, of the same
+// size and ops, or for n problems picked from the list at random.
+
+struct Task
+{
+	int size;
+	string operators;
+};
+
+static bool read_tasks(const char* path, std::vector<Task>* tasks)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return false;
+	// "   3: 08KtJY0RaALDCU7k7FSAyOLH  23  ...  [ 8]: and if0 not or plus"
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		Task t;
+		const char* ops = strstr(line, "]:");
+		if (!ops || sscanf(line, "%*d: %*s %d", &t.size) != 1)
+			continue;
+		t.operators = ops + 2;
+		t.operators.erase(t.operators.find_last_not_of(" \r\n") + 1);
+		t.operators.erase(0, t.operators.find_first_not_of(' '));
+		tasks->push_back(t);
+	}
+	fclose(f);
+	return true;
+}
+
+static string ops_of(int argc, char* argv[], int first)
+{
+	string ops;
+	for (int i = first; i < argc; i++)
+		ops += (i > first ? " " : "") + string(argv[i]);
+	return ops;
+}
+
+// why nothing was drawn.
+static void no_program(Sampler* sampler, int size, const string& ops)
+{
+	if (sampler->count(size)) {
+		fprintf(stderr, "too few programs of size %d with %s use all of them\n", size, ops.c_str());
+		return;
+	}
+	int smallest = sampler->min_size(64);
+	if (smallest)
+		fprintf(stderr, "no program of size %d uses all of %s, the smallest size for them is %d\n",
+			size, ops.c_str(), smallest);
+	else
+		fprintf(stderr, "no program uses all of %s\n", ops.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 3 && !strcmp(argv[1], "count")) {
+		Sampler sampler(1);
+		if (!sampler.set_operators(ops_of(argc, argv, 3))) {
+			fprintf(stderr, "unknown op in %s\n", ops_of(argc, argv, 3).c_str());
+			return 1;
+		}
+		printf("%s\n", Sampler::to_string(sampler.count(atoi(argv[2]))).c_str());
+		return 0;
+	}
+	if (argc > 5 && !strcmp(argv[1], "draw")) {
+		Sampler sampler(strtoull(argv[4], NULL, 10));
+		if (!sampler.set_operators(ops_of(argc, argv, 5))) {
+			fprintf(stderr, "unknown op in %s\n", ops_of(argc, argv, 5).c_str());
+			return 1;
+		}
+		for (int i = 0; i < atoi(argv[3]); i++) {
+			ExprPool pool;
+			Expr* e = sampler.sample(atoi(argv[2]), &pool);
+			if (!e) {
+				no_program(&sampler, atoi(argv[2]), ops_of(argc, argv, 5));
+				return 1;
+			}
+			printf("%s\n", e->program().c_str());
+		}
+		return 0;
+	}
+	if (argc < 4 || strcmp(argv[1], "tasks")) {
+		fprintf(stderr, "usage: %s count size ops...\n"
+			"       %s draw size n seed ops...\n"
+			"       %s tasks tasks.txt secrets.txt [seed] [n]\n", argv[0], argv[0], argv[0]);
+		return 1;
+	}
+
+	std::vector<Task> tasks;
+	if (!read_tasks(argv[2], &tasks) || tasks.empty()) {
+		fprintf(stderr, "no tasks in %s\n", argv[2]);
+		return 1;
+	}
+	uint64_t seed = argc > 4 ? strtoull(argv[4], NULL, 10) : 1;
+	int n = argc > 5 ? atoi(argv[5]) : tasks.size();
+	FILE* out = fopen(argv[3], "w");
+	if (!out) {
+		perror(argv[3]);
+		return 1;
+	}
+
+	Sampler picker(seed ^ 0x5bd1e995);
+	int written = 0;
+	for (int i = 0; i < n; i++) {
+		const Task& t = n == tasks.size() ? tasks[i] : tasks[picker.below(tasks.size())];
+		// a sampler per problem, so one problem's draws don't shift the rest.
+		Sampler sampler(seed * 1000003 + i);
+		ExprPool pool;
+		if (!sampler.set_operators(t.operators)) {
+			fprintf(stderr, "unknown op in %s\n", t.operators.c_str());
+			continue;
+		}
+		Expr* e = sampler.sample(t.size, &pool);
+		if (!e) {
+			no_program(&sampler, t.size, t.operators);
+			continue;
+		}
+		string ops = t.operators;
+		for (int k = 0; k < ops.size(); k++)
+			if (ops[k] == ' ')
+				ops[k] = ',';
+		fprintf(out, "syn%05d %d %s %s\n", i, t.size, ops.c_str(), e->program().c_str());
+		written++;
+	}
+	fclose(out);
+	printf("%d of %d problems written to %s\n", written, n, argv[3]);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "gen2.h"
+#include "bank.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Draws programs uniformly at random from the ones of a given size and op
+// set, for secrets of a mock server or benchmark workloads. Terms are
+// counted exactly by size over the grammar Arena enumerates: leaves 0, 1
+// and the variables in scope, at most one fold with a fold-free lambda, and
+// the tfold and bonus shapes of ArenaTfold and ArenaBonus. A draw walks
+// down the counts, so every program is equally likely; those missing a
+// listed op are drawn again, which keeps it uniform over the programs using
+// exactly the listed ops, as contest problems did.
+class Sampler
+{
+public:
+	typedef unsigned __int128 Count;
+
+	Sampler(uint64_t seed);
+
+	// ops as in a problem list, e.g. "fold if0 plus"; false on an unknown one.
+	bool set_operators(const string& ops);
+
+	// programs of exactly this size using all the listed ops and no other,
+	// by inclusion and exclusion over the ops that may be left out.
+	Count count(int size);
+	// the smallest size count() is not 0 for, 0 if none is up to max.
+	int min_size(int max);
+	// NULL if there are none, or if too few of the programs drawn use all
+	// the listed ops.
+	Expr* sample(int size, ExprPool* pool);
+
+	static string to_string(Count c);
+
+	// uniform in [0, n).
+	Count below(Count n);
+
+	// draws before giving up on finding all the listed ops.
+	int max_tries_;
+
+private:
+	// terms by size over the allowed ops: with x0 only and no fold, inside
+	// the fold lambda (x0, x1, x2), and with x0 and exactly one fold.
+	struct Table {
+		std::vector<Count> top, lambda, fold;
+	};
+
+	void tabulate(OpSet ops, int max, Table* t) const;
+	// all terms of the problem's shape, ops allowed but not required.
+	Count shapes(const Table& t, int size) const;
+
+	Expr* term(int kind, int size, ExprPool* pool);
+	uint64_t next();
+
+	OpSet listed_; // plain ops, not fold, tfold or bonus
+	bool fold_;
+	bool tfold_;
+	bool bonus_;
+	Table table_;
+	int table_max_;
+	uint64_t state_;
+};
+
+#endif
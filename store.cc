@@ -0,0 +1,226 @@
+#define __STDC_FORMAT_MACROS
+
+#include "store.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+
+ProblemStore::Status ProblemStore::Problem::status() const
+{
+	if (solved)
+		return SOLVED;
+	if (time_left == 0)
+		return FAILED;
+	if (time_left > 0 || !pairs.empty())
+		return STARTED;
+	return OPEN;
+}
+
+ProblemStore::~ProblemStore()
+{
+	if (file_)
+		fclose(file_);
+}
+
+int ProblemStore::open(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (f) {
+		char line[4096];
+		while (fgets(line, sizeof(line), f))
+			apply(line);
+		fclose(f);
+	}
+	file_ = fopen(path, "a");
+	if (!file_)
+		fprintf(stderr, "store: can't append to %s\n", path);
+	return problems_.size();
+}
+
+// replays one record, without logging it again.
+void ProblemStore::apply(const char* line)
+{
+	char kind;
+	char id[64];
+	int skip;
+	if (sscanf(line, "%c %63s %n", &kind, id, &skip) < 2)
+		return;
+	const char* rest = line + skip;
+	string text = rest;
+	text.erase(text.find_last_not_of("\r\n") + 1);
+
+	FILE* saved = file_;
+	file_ = NULL;
+	if (kind == 'P') {
+		int size;
+		int n;
+		if (sscanf(rest, "%d %n", &size, &n) >= 1) {
+			string ops = text.substr(n);
+			for (int i = 0; i < ops.size(); i++)
+				if (ops[i] == ',')
+					ops[i] = ' ';
+			update(id, size, ops, false, -1);
+		}
+	} else if (kind == 'E' || kind == 'M') {
+		Val in, out;
+		Problem* p = get(id);
+		if (p && sscanf(rest, "%" SCNx64 " %" SCNx64, &in, &out) == 2) {
+			Status before = p->status();
+			add_pair(p, in, out);
+			reindex(p - &problems_[0], before);
+		}
+	} else if (kind == 'S') {
+		int solved, time_left, n;
+		Problem* p = get(id);
+		if (p && sscanf(rest, "%d %d %n", &solved, &time_left, &n) >= 2) {
+			Status before = p->status();
+			p->solved = solved;
+			p->time_left = time_left;
+			if (n < text.size())
+				p->program = text.substr(n);
+			reindex(p - &problems_[0], before);
+		}
+	}
+	file_ = saved;
+}
+
+void ProblemStore::log(const char* format, ...)
+{
+	if (!file_)
+		return;
+	va_list args;
+	va_start(args, format);
+	vfprintf(file_, format, args);
+	va_end(args);
+	// a crash must not lose pairs paid with evals.
+	fflush(file_);
+}
+
+ProblemStore::Problem* ProblemStore::get(const string& id)
+{
+	std::map<string, int>::iterator it = by_id_.find(id);
+	return it == by_id_.end() ? NULL : &problems_[it->second];
+}
+
+const ProblemStore::Problem* ProblemStore::find(const string& id) const
+{
+	std::map<string, int>::const_iterator it = by_id_.find(id);
+	return it == by_id_.end() ? NULL : &problems_[it->second];
+}
+
+void ProblemStore::reindex(int k, Status before)
+{
+	Status after = problems_[k].status();
+	if (after == before)
+		return;
+	by_status_[before].erase(k);
+	by_status_[after].insert(k);
+}
+
+void ProblemStore::update(const string& id, int size, const string& ops, bool solved, int time_left)
+{
+	Problem* p = get(id);
+	if (!p) {
+		int k = problems_.size();
+		problems_.push_back(Problem());
+		p = &problems_.back();
+		p->id = id;
+		p->size = size;
+		p->ops = ops;
+		p->solved = false;
+		p->time_left = -1;
+		by_id_[id] = k;
+		by_size_.insert(std::make_pair(size, k));
+		by_ops_.insert(std::make_pair(ops, k));
+		by_status_[OPEN].insert(k);
+		string logged = ops;
+		for (int i = 0; i < logged.size(); i++)
+			if (logged[i] == ' ')
+				logged[i] = ',';
+		log("P %s %d %s\n", id.c_str(), size, logged.c_str());
+	}
+	// the server may not know about a win we logged yet.
+	solved = p->solved || solved;
+	if (p->solved == solved && p->time_left == time_left)
+		return;
+	Status before = p->status();
+	p->solved = solved;
+	p->time_left = time_left;
+	reindex(p - &problems_[0], before);
+	log("S %s %d %d %s\n", id.c_str(), p->solved, p->time_left, p->program.c_str());
+}
+
+void ProblemStore::add_pair(Problem* p, Val in, Val out)
+{
+	if (p->outputs.insert(std::make_pair(in, out)).second)
+		p->pairs.push_back(std::make_pair(in, out));
+}
+
+void ProblemStore::add_eval(const string& id, Val in, Val out)
+{
+	Problem* p = get(id);
+	if (!p || p->outputs.count(in))
+		return;
+	Status before = p->status();
+	add_pair(p, in, out);
+	reindex(p - &problems_[0], before);
+	log("E %s %" PRIx64 " %" PRIx64 "\n", id.c_str(), in, out);
+}
+
+void ProblemStore::add_mismatch(const string& id, Val in, Val out)
+{
+	Problem* p = get(id);
+	if (!p || p->outputs.count(in))
+		return;
+	Status before = p->status();
+	add_pair(p, in, out);
+	reindex(p - &problems_[0], before);
+	log("M %s %" PRIx64 " %" PRIx64 "\n", id.c_str(), in, out);
+}
+
+void ProblemStore::set_solved(const string& id, const string& program)
+{
+	Problem* p = get(id);
+	if (!p)
+		return;
+	Status before = p->status();
+	p->solved = true;
+	p->program = program;
+	reindex(p - &problems_[0], before);
+	log("S %s %d %d %s\n", id.c_str(), 1, p->time_left, program.c_str());
+}
+
+bool ProblemStore::output(const string& id, Val in, Val* out) const
+{
+	const Problem* p = find(id);
+	if (!p)
+		return false;
+	std::map<Val, Val>::const_iterator it = p->outputs.find(in);
+	if (it == p->outputs.end())
+		return false;
+	*out = it->second;
+	return true;
+}
+
+void ProblemStore::by_size(int size, std::vector<int>* problems) const
+{
+	std::pair<std::multimap<int, int>::const_iterator, std::multimap<int, int>::const_iterator> range =
+		by_size_.equal_range(size);
+	for (std::multimap<int, int>::const_iterator it = range.first; it != range.second; ++it)
+		problems->push_back(it->second);
+}
+
+void ProblemStore::by_ops(const string& ops, std::vector<int>* problems) const
+{
+	std::pair<std::multimap<string, int>::const_iterator, std::multimap<string, int>::const_iterator> range =
+		by_ops_.equal_range(ops);
+	for (std::multimap<string, int>::const_iterator it = range.first; it != range.second; ++it)
+		problems->push_back(it->second);
+}
+
+void ProblemStore::sizes(std::map<int, int>* counts) const
+{
+	for (std::multimap<int, int>::const_iterator it = by_size_.begin(); it != by_size_.end(); ++it)
+		(*counts)[it->first]++;
+}
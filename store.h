@@ -0,0 +1,74 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include "gen2.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+// Everything learnt about our problems, kept in an append-only text log
+// replayed at startup: "P id size ops" when a problem is first listed,
+// "E id in out" for every eval pair, "M id in out" for every mismatch and
+// "S id solved time_left [program]" when its status changes. Problems are
+// indexed by size, operators and status, so scheduling needs no request
+// and a restarted challenge gets its pairs back without spending evals.
+class ProblemStore
+{
+public:
+	enum Status { OPEN, STARTED, SOLVED, FAILED, NUM_STATUS };
+
+	struct Problem {
+		string id;
+		int size;
+		string ops; // space separated, as the server lists them
+		bool solved;
+		int time_left; // -1 until the server reports one
+		string program;
+		std::vector<std::pair<Val, Val> > pairs;
+		std::map<Val, Val> outputs;
+
+		Status status() const;
+	};
+
+	ProblemStore() : file_(NULL) {}
+	~ProblemStore();
+
+	// replays the log, then appends to it.
+	int open(const char* path);
+
+	// a problem as listed by the server, logged if new or changed.
+	void update(const string& id, int size, const string& ops, bool solved, int time_left);
+	void add_eval(const string& id, Val in, Val out);
+	void add_mismatch(const string& id, Val in, Val out);
+	void set_solved(const string& id, const string& program);
+
+	int count() const { return problems_.size(); }
+	const Problem& problem(int k) const { return problems_[k]; }
+	// NULL if unknown.
+	const Problem* find(const string& id) const;
+	// true with out set if the output of in is known.
+	bool output(const string& id, Val in, Val* out) const;
+
+	void by_size(int size, std::vector<int>* problems) const;
+	void by_ops(const string& ops, std::vector<int>* problems) const;
+	const std::set<int>& by_status(Status s) const { return by_status_[s]; }
+	// sizes with their number of problems.
+	void sizes(std::map<int, int>* counts) const;
+
+private:
+	void apply(const char* line);
+	Problem* get(const string& id);
+	void add_pair(Problem* p, Val in, Val out);
+	void reindex(int k, Status before);
+	void log(const char* format, ...);
+
+	std::vector<Problem> problems_;
+	std::map<string, int> by_id_;
+	std::multimap<int, int> by_size_;
+	std::multimap<string, int> by_ops_;
+	std::set<int> by_status_[NUM_STATUS];
+	FILE* file_;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "telemetry.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// the counters of a thread, kept after it is gone.
+struct Block
+{
+	uint64_t counts[Telemetry::MAX_COUNTER];
+	Block* next;
+};
+
+__thread uint64_t* Telemetry::counts_ = NULL;
+
+static pthread_mutex_t blocks_lock_ = PTHREAD_MUTEX_INITIALIZER;
+static Block* blocks_ = NULL;
+static FILE* file_ = NULL;
+static int period_ms_ = 0;
+static uint64_t started_ns_ = 0;
+static volatile bool running_ = false;
+static pthread_t snapshots_;
+
+uint64_t Telemetry::now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+uint64_t* Telemetry::attach()
+{
+	Block* b = new Block;
+	memset(b->counts, 0, sizeof(b->counts));
+	pthread_mutex_lock(&blocks_lock_);
+	b->next = blocks_;
+	blocks_ = b;
+	pthread_mutex_unlock(&blocks_lock_);
+	counts_ = b->counts;
+	return counts_;
+}
+
+void Telemetry::read(Totals* totals)
+{
+	memset(totals->counts, 0, sizeof(totals->counts));
+	pthread_mutex_lock(&blocks_lock_);
+	for (Block* b = blocks_; b; b = b->next)
+		for (int i = 0; i < MAX_COUNTER; i++)
+			totals->counts[i] += __atomic_load_n(&b->counts[i], __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&blocks_lock_);
+}
+
+const char* Telemetry::name(int counter)
+{
+	static const char* ops[MAX_OP] = {
+		"push.dummy", "push.if0", "push.fold", "push.not", "push.shl1", "push.shr1",
+		"push.shr4", "push.shr16", "push.and", "push.or", "push.xor", "push.plus",
+		"push.0", "push.1", "push.var", "push.tfold"
+	};
+	static const char* rest[] = {
+		"completed", "pruned_bits"
+	};
+	static const char* after_rules[] = {
+		"fold_lambdas", "verify_first", "verify_later", "verify_passed",
+		"multi_scan_miss", "multi_hash_miss", "multi_routed",
+		"eval_ns", "eval_samples", "guess_win", "guess_mismatch", "guess_error"
+	};
+	static char rules[MAX_RULE][32];
+
+	if (counter < COMPLETED)
+		return ops[counter - PUSH] ? ops[counter - PUSH] : "push.?";
+	if (counter < RULE)
+		return rest[counter - COMPLETED];
+	if (counter < FOLD_LAMBDAS) {
+		int r = counter - RULE;
+		if (!rules[r][0])
+			snprintf(rules[r], sizeof(rules[r]), "rule.%s", Rules::table_[r].name);
+		return rules[r];
+	}
+	return after_rules[counter - FOLD_LAMBDAS];
+}
+
+void Telemetry::snapshot(FILE* f)
+{
+	Totals t;
+	read(&t);
+	fprintf(f, "{\"ms\": %lu", (unsigned long)((now_ns() - started_ns_) / 1000000));
+	for (int i = 0; i < MAX_COUNTER; i++)
+		if (t.counts[i])
+			fprintf(f, ", \"%s\": %lu", name(i), (unsigned long)t.counts[i]);
+	fprintf(f, "}\n");
+	fflush(f);
+}
+
+static void* snapshot_loop(void*)
+{
+	while (running_) {
+		// short naps, so that stop does not wait out a whole period.
+		for (int slept = 0; slept < period_ms_ && running_; slept += 10)
+			usleep(10000);
+		Telemetry::snapshot(file_);
+	}
+	return NULL;
+}
+
+bool Telemetry::start(const char* path, int period_ms)
+{
+	if (running_)
+		return true;
+	file_ = fopen(path, "a");
+	if (!file_)
+		return false;
+	period_ms_ = period_ms;
+	started_ns_ = now_ns();
+	running_ = true;
+	if (pthread_create(&snapshots_, NULL, snapshot_loop, NULL)) {
+		running_ = false;
+		fclose(file_);
+		file_ = NULL;
+		return false;
+	}
+	return true;
+}
+
+void Telemetry::stop()
+{
+	if (!running_)
+		return;
+	running_ = false;
+	pthread_join(snapshots_, NULL);
+	fclose(file_);
+	file_ = NULL;
+}
+
+void Telemetry::print_delta(const Totals& before, const Totals& after)
+{
+	uint64_t d[MAX_COUNTER];
+	for (int i = 0; i < MAX_COUNTER; i++)
+		d[i] = after.counts[i] - before.counts[i];
+	uint64_t pushes = 0, rules = 0;
+	for (int op = 0; op < MAX_OP; op++)
+		pushes += d[PUSH + op];
+	for (int r = 0; r < MAX_RULE; r++)
+		rules += d[RULE + r];
+	printf("telemetry: %lu pushes, %lu completed, %lu pruned by bits, %lu by rules, %lu folds, "
+		"verifier %lu/%lu/%lu, %.0f ns per candidate, guesses %lu/%lu/%lu\n",
+		(unsigned long)pushes, (unsigned long)d[COMPLETED], (unsigned long)d[PRUNED_BITS],
+		(unsigned long)rules, (unsigned long)d[FOLD_LAMBDAS], (unsigned long)d[VERIFY_FIRST],
+		(unsigned long)d[VERIFY_LATER], (unsigned long)d[VERIFY_PASSED],
+		d[EVAL_SAMPLES] ? 1. * d[EVAL_NS] / d[EVAL_SAMPLES] : 0.,
+		(unsigned long)d[GUESS_WIN], (unsigned long)d[GUESS_MISMATCH], (unsigned long)d[GUESS_ERROR]);
+}
+
+void Telemetry::print_rules()
+{
+	Totals t;
+	read(&t);
+	for (int i = 0; i < MAX_RULE; i++) {
+		uint64_t hits = t.counts[RULE + i];
+		bool on = Rules::enabled((RuleId)i);
+		if (hits || !on)
+			printf("rule %-13s %s %10lu\n", Rules::table_[i].name, on ? "on " : "off", (unsigned long)hits);
+	}
+}
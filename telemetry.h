@@ -0,0 +1,73 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "gen2.h"
+#include "rules.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Counters of what the search does, cheap enough to stay on. Every thread
+// bumps counters of its own without atomics or locks; a read sums them up
+// over all threads. A background thread can append a snapshot to a file,
+// or a fifo, every so often, one JSON object per line.
+class Telemetry
+{
+public:
+	enum Counter {
+		PUSH,                           // + op, nodes Arena pushed
+		COMPLETED = PUSH + MAX_OP,      // programs Arena completed
+		PRUNED_BITS,                    // of them, at odds with the observed bits
+		RULE,                           // + RuleId, emits a rewrite rule rejected
+		FOLD_LAMBDAS = RULE + MAX_RULE, // lambdas made into a fold
+		VERIFY_FIRST,                   // candidates failing the first pair
+		VERIFY_LATER,                   // failing another one
+		VERIFY_PASSED,
+		MULTI_SCAN_MISS,                // MultiVerifier: no problem has the first output
+		MULTI_HASH_MISS,                // nor all of them
+		MULTI_ROUTED,
+		EVAL_NS,                        // verifying the sampled candidates
+		EVAL_SAMPLES,
+		GUESS_WIN,
+		GUESS_MISMATCH,
+		GUESS_ERROR,
+		MAX_COUNTER
+	};
+
+	struct Totals {
+		uint64_t counts[MAX_COUNTER];
+	};
+
+	static void add(int counter, uint64_t n = 1)
+	{
+		uint64_t* c = counts_ ? counts_ : attach();
+		// only this thread writes it, the store just has to be whole.
+		__atomic_store_n(&c[counter], c[counter] + n, __ATOMIC_RELAXED);
+	}
+
+	// one in this many candidates gets its verification timed.
+	enum { EVAL_SAMPLING = 1024 };
+	static uint64_t now_ns();
+
+	// sums over all threads so far.
+	static void read(Totals* totals);
+	static const char* name(int counter);
+
+	// appends a snapshot every period_ms, false if path can't be written.
+	static bool start(const char* path, int period_ms);
+	// writes a last snapshot.
+	static void stop();
+	static void snapshot(FILE* f);
+
+	// what happened between two reads, on a line.
+	static void print_delta(const Totals& before, const Totals& after);
+	// rejections by each rewrite rule so far, and the rules switched off.
+	static void print_rules();
+
+private:
+	static uint64_t* attach();
+
+	static __thread uint64_t* counts_;
+};
+
+#endif